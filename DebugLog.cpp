@@ -0,0 +1,143 @@
+#include "DebugLog.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Message types in the order they are counted.
+static const GLenum MessageTypes[] = {
+  GL_DEBUG_TYPE_ERROR, GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR, GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR,
+  GL_DEBUG_TYPE_PORTABILITY, GL_DEBUG_TYPE_PERFORMANCE, GL_DEBUG_TYPE_MARKER,
+  GL_DEBUG_TYPE_PUSH_GROUP, GL_DEBUG_TYPE_POP_GROUP, GL_DEBUG_TYPE_OTHER
+};
+static const char* MessageTypeNames[] = {
+  "error", "deprecated", "undefined", "portability", "performance", "marker", "push", "pop", "other"
+};
+static const size_t NumMessageTypes = DebugLog::NumMessageTypes;
+static_assert(sizeof(MessageTypes) / sizeof(MessageTypes[0]) == NumMessageTypes, "One GL type per counted type");
+static_assert(sizeof(MessageTypeNames) / sizeof(MessageTypeNames[0]) == NumMessageTypes, "One name per counted type");
+
+static size_t typeIndex(GLenum type) {
+  for (size_t i = 0; i < NumMessageTypes; i++) {
+    if (MessageTypes[i] == type) { return i; }
+  }
+  return NumMessageTypes - 1;
+}
+
+static const char* severityName(GLenum severity) {
+  switch (severity) {
+    case GL_DEBUG_SEVERITY_HIGH: return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW: return "low";
+    default: return "notification";
+  }
+}
+
+DebugLog::DebugLog(size_t capacity)
+  : capacity(capacity), entries(new Entry[capacity]), writeIndex(0), currentFrame(0), performanceThisFrame(0) {
+  for (size_t i = 0; i < capacity; i++) {
+    entries[i].sequence.store(0, std::memory_order_relaxed);
+  }
+  for (auto& c : countsByType) {
+    c.store(0, std::memory_order_relaxed);
+  }
+}
+
+void DebugLog::install() {
+  glEnable(GL_DEBUG_OUTPUT);
+  glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+  glDebugMessageCallback(callback, this);
+}
+
+void GLAPIENTRY DebugLog::callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+  GLsizei length, const GLchar* message, const void* userParam) {
+  static_cast<DebugLog*>(const_cast<void*>(userParam))->add(source, type, id, severity, length, message);
+}
+
+void DebugLog::add(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message) {
+  countsByType[typeIndex(type)].fetch_add(1, std::memory_order_relaxed);
+  if (type == GL_DEBUG_TYPE_PERFORMANCE) {
+    performanceThisFrame.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Claim a slot and fill it in.
+  uint64_t index = writeIndex.fetch_add(1, std::memory_order_relaxed);
+  Entry& e = entries[index % capacity];
+  e.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  e.frame = currentFrame.load(std::memory_order_relaxed);
+  e.source = source;
+  e.type = type;
+  e.id = id;
+  e.severity = severity;
+  size_t n = length >= 0 ? static_cast<size_t>(length) : std::strlen(message);
+  n = std::min(n, MaxMessageLength - 1);
+  std::memcpy(e.message, message, n);
+  e.message[n] = '\0';
+  e.sequence.store(index + 1, std::memory_order_release);
+}
+
+void DebugLog::beginFrame(size_t frameNumber) {
+  if (frameNumber > 0) {
+    performancePerFrame.push_back(performanceThisFrame.exchange(0, std::memory_order_relaxed));
+  }
+  currentFrame.store(frameNumber, std::memory_order_relaxed);
+}
+
+void DebugLog::report() {
+  // The last frame's count is otherwise only taken when a next frame begins.
+  performancePerFrame.push_back(performanceThisFrame.exchange(0, std::memory_order_relaxed));
+
+  uint64_t total = writeIndex.load(std::memory_order_acquire);
+  std::cout << "OpenGL debug messages: " << total << std::endl;
+  for (size_t i = 0; i < NumMessageTypes; i++) {
+    uint64_t c = countsByType[i].load(std::memory_order_relaxed);
+    if (c > 0) {
+      std::cout << "  " << MessageTypeNames[i] << ": " << c << std::endl;
+    }
+  }
+
+  size_t framesWithWarnings = 0;
+  uint32_t maxWarnings = 0;
+  size_t worstFrame = 0;
+  for (size_t f = 0; f < performancePerFrame.size(); f++) {
+    if (performancePerFrame[f] > 0) {
+      framesWithWarnings++;
+      if (performancePerFrame[f] > maxWarnings) {
+        maxWarnings = performancePerFrame[f];
+        worstFrame = f;
+      }
+    }
+  }
+  std::cout << "  Frames with performance warnings: " << framesWithWarnings << " of " << performancePerFrame.size();
+  if (maxWarnings > 0) {
+    std::cout << " (most: " << maxWarnings << " in frame " << worstFrame << ")";
+  }
+  std::cout << std::endl;
+
+  // Dump the buffered messages oldest first, skipping any slot that is mid-write.  Driver threads may
+  // still be adding messages, so each entry is copied and only printed if its slot was not reused
+  // while the copy was made.
+  uint64_t first = total > capacity ? total - capacity : 0;
+  if (first > 0) {
+    std::cout << "  (" << first << " older messages were overwritten)" << std::endl;
+  }
+  for (uint64_t index = first; index < total; index++) {
+    const Entry& e = entries[index % capacity];
+    if (e.sequence.load(std::memory_order_acquire) != index + 1) {
+      continue;
+    }
+    size_t frame = e.frame;
+    GLenum type = e.type;
+    GLenum severity = e.severity;
+    GLuint id = e.id;
+    char message[MaxMessageLength];
+    std::memcpy(message, e.message, MaxMessageLength);
+    message[MaxMessageLength - 1] = '\0';
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (e.sequence.load(std::memory_order_relaxed) != index + 1) {
+      continue;
+    }
+    std::cout << "  [frame " << frame << "] " << MessageTypeNames[typeIndex(type)] << " "
+      << severityName(severity) << " " << id << ": " << message << std::endl;
+  }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// Collects GL_KHR_debug messages from the driver, including performance warnings such as buffer
+// stalls and shader recompiles, without slowing the render loop.  The callback may be called from
+// driver threads, so messages go into a fixed-size lock-free ring buffer (oldest entries are
+// overwritten) tagged with the frame number, and performance messages are counted per frame.  Nothing
+// is printed until report() is called at exit.
+
+class DebugLog {
+public:
+  explicit DebugLog(size_t capacity = 4096);
+
+  // Register the callback with the current context, which should be a debug context.
+  void install();
+
+  // Mark the start of a frame.  Called only from the render thread.
+  void beginFrame(size_t frameNumber);
+
+  // Print counts, the per-frame performance-warning statistics and the buffered messages.  Call once,
+  // at exit; the frame in progress is counted as the last frame.
+  void report();
+
+  // Number of message types counted separately; the last one counts any type not listed.
+  static const size_t NumMessageTypes = 9;
+
+private:
+  DebugLog(const DebugLog&) = delete;
+  DebugLog& operator=(const DebugLog&) = delete;
+
+  static void GLAPIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei length, const GLchar* message, const void* userParam);
+  void add(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message);
+
+  // A slot's sequence is 0 while it is being written and otherwise one more than the index of the
+  // message it holds.
+  static const size_t MaxMessageLength = 240;
+  struct Entry {
+    std::atomic<uint64_t> sequence;
+    size_t frame;
+    GLenum source;
+    GLenum type;
+    GLenum severity;
+    GLuint id;
+    char message[MaxMessageLength];
+  };
+
+  size_t capacity;
+  std::unique_ptr<Entry[]> entries;
+  std::atomic<uint64_t> writeIndex;
+  std::atomic<size_t> currentFrame;
+  std::atomic<uint32_t> performanceThisFrame;
+  std::atomic<uint64_t> countsByType[NumMessageTypes];
+
+  // Performance-warning count for each completed frame, owned by the render thread.
+  std::vector<uint32_t> performancePerFrame;
+};
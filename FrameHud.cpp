@@ -0,0 +1,322 @@
+#include "FrameHud.h"
+#include "ShaderUtils.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// Number of frames whose timestamps may be in flight before beginFrame() has to wait for the oldest.
+static const size_t NumSlots = 4;
+
+// Frame intervals averaged for the frame rate shown.
+static const size_t RateFrames = 60;
+
+// Layout in units of the overlay's scale: the panel's margin and padding, the size of a character
+// cell and of the graph, which spans two refresh periods.
+static const float Margin = 8;
+static const float Padding = 6;
+static const float CharWidth = 6;
+static const float LineHeight = 10;
+static const float BarWidth = 2;
+static const float GraphHeight = 100;
+
+static const uint8_t BackgroundColor[4] = { 0, 0, 0, 160 };
+static const uint8_t TextColor[4] = { 255, 255, 255, 255 };
+static const uint8_t CpuColor[4] = { 255, 160, 0, 255 };
+static const uint8_t GpuColor[4] = { 0, 200, 255, 255 };
+static const uint8_t PeriodColor[4] = { 255, 255, 255, 128 };
+
+// 5x7 glyphs, one byte per row from the top with the leftmost pixel in bit 4, in the order of FontChars.
+// Other characters are drawn as spaces.
+static const char FontChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:-/";
+static const uint8_t Font[][7] = {
+  { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+  { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+  { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+  { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+  { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+  { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },
+  { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },
+  { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },
+  { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+  { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },
+  { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },
+  { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+  { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },
+  { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },
+  { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+  { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+  { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },
+  { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },
+  { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },
+  { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }
+};
+static const int NumGlyphs = sizeof(Font) / sizeof(Font[0]);
+
+// Each instance is a quad whose corners come from gl_VertexID, so there is no vertex buffer.
+static const GLchar* HudVertexShader =
+R"(#version 330 core
+   layout(location = 0) in vec4 rect;
+   layout(location = 1) in vec4 color;
+   layout(location = 2) in float glyph;
+   uniform vec2 viewportSize;
+   out vec4 quadColor;
+   out vec2 glyphCoord;
+   flat out int glyphIndex;
+   void main()
+   {
+      vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+      vec2 pixel = rect.xy + corner * rect.zw;
+      gl_Position = vec4(2.0 * pixel.x / viewportSize.x - 1.0, 1.0 - 2.0 * pixel.y / viewportSize.y, 0.0, 1.0);
+      quadColor = color;
+      glyphCoord = corner * vec2(5.0, 7.0);
+      glyphIndex = int(glyph);
+   })";
+
+static const GLchar* HudFragmentShader =
+R"(#version 330 core
+   uniform sampler2D font;
+   in vec4 quadColor;
+   in vec2 glyphCoord;
+   flat in int glyphIndex;
+   layout(location = 0) out vec4 fragColor;
+   void main()
+   {
+      if (glyphIndex >= 0) {
+         ivec2 texel = ivec2(glyphIndex * 5 + min(int(glyphCoord.x), 4), min(int(glyphCoord.y), 6));
+         if (texelFetch(font, texel, 0).r < 0.5) {
+            discard;
+         }
+      }
+      fragColor = quadColor;
+   })";
+
+FrameHud::FrameHud(int width, int height, double refreshRate)
+  : width(width), height(height), refreshPeriod(1.0 / refreshRate), slots(NumSlots),
+    cpuTimes(History, 0.0f), gpuTimes(History, 0.0f) {
+  setSize(width, height);
+
+  program = buildProgram(HudVertexShader, HudFragmentShader, "HUD");
+  viewportSizeUniform = glGetUniformLocation(program, "viewportSize");
+  glUseProgram(program);
+  glUniform1i(glGetUniformLocation(program, "font"), 0);
+  glUseProgram(0);
+
+  // The glyphs side by side in one row of a single-channel texture.
+  std::vector<uint8_t> texels(NumGlyphs * 5 * 7);
+  for (int g = 0; g < NumGlyphs; g++) {
+    for (int y = 0; y < 7; y++) {
+      for (int x = 0; x < 5; x++) {
+        texels[y * NumGlyphs * 5 + g * 5 + x] = (Font[g][y] >> (4 - x)) & 1 ? 255 : 0;
+      }
+    }
+  }
+  glGenTextures(1, &fontTexture);
+  glBindTexture(GL_TEXTURE_2D, fontTexture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, NumGlyphs * 5, 7, 0, GL_RED, GL_UNSIGNED_BYTE, texels.data());
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glGenVertexArrays(1, &vertexArray);
+  glGenBuffers(1, &instanceBuffer);
+  glBindVertexArray(vertexArray);
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(Quad), reinterpret_cast<GLvoid*>(offsetof(Quad, rect)));
+  glEnableVertexAttribArray(1);
+  glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Quad), reinterpret_cast<GLvoid*>(offsetof(Quad, color)));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Quad), reinterpret_cast<GLvoid*>(offsetof(Quad, glyph)));
+  for (GLuint a = 0; a < 3; a++) {
+    glVertexAttribDivisor(a, 1);
+  }
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  for (Slot& slot : slots) {
+    glGenQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+  }
+}
+
+FrameHud::~FrameHud() {
+  for (Slot& slot : slots) {
+    glDeleteQueries(static_cast<GLsizei>(slot.queries.size()), slot.queries.data());
+  }
+  glDeleteBuffers(1, &instanceBuffer);
+  glDeleteVertexArrays(1, &vertexArray);
+  glDeleteTextures(1, &fontTexture);
+  glDeleteProgram(program);
+}
+
+void FrameHud::setSize(int width, int height) {
+  this->width = width;
+  this->height = height;
+  // Keep the overlay the same size relative to the screen on 4K and 8K displays.
+  scale = std::max(1.0f, std::round(height / 1080.0f));
+}
+
+void FrameHud::beginFrame() {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  if (started) {
+    double interval = std::chrono::duration<double>(now - lastFrame).count();
+    cpuTimes[cpuNext] = static_cast<float>(interval);
+    cpuNext = (cpuNext + 1) % History;
+    framesTimed++;
+    long periods = std::lround(interval / refreshPeriod);
+    if (periods > 1) {
+      missedVblanks += periods - 1;
+    }
+  }
+  lastFrame = now;
+  started = true;
+
+  // Read the timestamps of the frame that last used this slot, waiting if they are not ready.
+  Slot& slot = slots[nextSlot];
+  if (slot.issued) {
+    GLuint available = 0;
+    glGetQueryObjectuiv(slot.queries[2], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      stalls++;
+    }
+    consume(slot);
+  }
+  glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+  current = &slot;
+}
+
+void FrameHud::setTornFrames(size_t frames) {
+  haveTornFrames = true;
+  tornFrames = frames;
+}
+
+void FrameHud::consume(Slot& slot) {
+  GLuint64 t[3];
+  for (size_t q = 0; q < slot.queries.size(); q++) {
+    glGetQueryObjectui64v(slot.queries[q], GL_QUERY_RESULT, &t[q]);
+  }
+  slot.issued = false;
+  gpuTimes[gpuNext] = static_cast<float>((t[1] - t[0]) * 1e-9);
+  gpuNext = (gpuNext + 1) % History;
+  double hudTime = (t[2] - t[1]) * 1e-9;
+  hudTimeTotal += hudTime;
+  hudTimeMax = std::max(hudTimeMax, hudTime);
+  gpuFrames++;
+}
+
+void FrameHud::addQuad(float x, float y, float w, float h, const uint8_t color[4], float glyph) {
+  Quad q;
+  q.rect[0] = x * scale;
+  q.rect[1] = y * scale;
+  q.rect[2] = w * scale;
+  q.rect[3] = h * scale;
+  std::memcpy(q.color, color, sizeof(q.color));
+  q.glyph = glyph;
+  quads.push_back(q);
+}
+
+void FrameHud::addText(float x, float y, const char* text, const uint8_t color[4]) {
+  for (const char* c = text; *c; c++, x += CharWidth) {
+    const char* found = std::strchr(FontChars, std::toupper(static_cast<unsigned char>(*c)));
+    if (*c != ' ' && found) {
+      addQuad(x, y, 5, 7, color, static_cast<float>(found - FontChars));
+    }
+  }
+}
+
+void FrameHud::draw() {
+  if (current) {
+    glQueryCounter(current->queries[1], GL_TIMESTAMP);
+  }
+
+  // The latest values: the mean of the recent intervals and the newest GPU time.
+  size_t rateFrames = std::min(framesTimed, RateFrames);
+  double recent = 0;
+  for (size_t i = 1; i <= rateFrames; i++) {
+    recent += cpuTimes[(cpuNext + History - i) % History];
+  }
+  double fps = recent > 0 ? rateFrames / recent : 0;
+  double cpuTime = framesTimed ? cpuTimes[(cpuNext + History - 1) % History] : 0;
+  double gpuTime = gpuFrames ? gpuTimes[(gpuNext + History - 1) % History] : 0;
+
+  // Background, two lines of text, then the graph with the oldest frame on the left.
+  quads.clear();
+  float graphWidth = History * BarWidth;
+  float graphTop = Margin + Padding + 2 * LineHeight + Padding;
+  addQuad(Margin, Margin, graphWidth + 2 * Padding, graphTop + GraphHeight + Padding - Margin, BackgroundColor);
+
+  char text[64];
+  float x = Margin + Padding;
+  float y = Margin + Padding;
+  std::snprintf(text, sizeof(text), "FPS %.1f", fps);
+  addText(x, y, text, TextColor);
+  std::snprintf(text, sizeof(text), "CPU %.2f ms", cpuTime * 1e3);
+  addText(x + 12 * CharWidth, y, text, CpuColor);
+  std::snprintf(text, sizeof(text), "GPU %.2f ms", gpuTime * 1e3);
+  addText(x + 27 * CharWidth, y, text, GpuColor);
+  y += LineHeight;
+  if (haveTornFrames) {
+    std::snprintf(text, sizeof(text), "Torn %zu", tornFrames);
+  } else {
+    std::snprintf(text, sizeof(text), "Torn -");
+  }
+  addText(x, y, text, TextColor);
+  std::snprintf(text, sizeof(text), "Missed vblanks %llu", static_cast<unsigned long long>(missedVblanks));
+  addText(x + 12 * CharWidth, y, text, TextColor);
+
+  float graphBottom = graphTop + GraphHeight;
+  float secondsToHeight = static_cast<float>(GraphHeight / (2 * refreshPeriod));
+  for (size_t i = 0; i < History; i++) {
+    float cpu = std::min(cpuTimes[(cpuNext + i) % History] * secondsToHeight, GraphHeight);
+    float gpu = std::min(gpuTimes[(gpuNext + i) % History] * secondsToHeight, GraphHeight);
+    float barX = Margin + Padding + i * BarWidth;
+    if (cpu > 0) { addQuad(barX, graphBottom - cpu, BarWidth / 2, cpu, CpuColor); }
+    if (gpu > 0) { addQuad(barX + BarWidth / 2, graphBottom - gpu, BarWidth / 2, gpu, GpuColor); }
+  }
+  addQuad(Margin + Padding, graphBottom - GraphHeight / 2, graphWidth, 1, PeriodColor);
+
+  glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(Quad) * quads.size(), quads.data(), GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+  glDisable(GL_DEPTH_TEST);
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glUseProgram(program);
+  glUniform2f(viewportSizeUniform, static_cast<float>(width), static_cast<float>(height));
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, fontTexture);
+  glBindVertexArray(vertexArray);
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(quads.size()));
+  glBindVertexArray(0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(previousProgram);
+  glDisable(GL_BLEND);
+  if (depthTest) {
+    glEnable(GL_DEPTH_TEST);
+  }
+
+  if (current) {
+    glQueryCounter(current->queries[2], GL_TIMESTAMP);
+    current->issued = true;
+    current = nullptr;
+    nextSlot = (nextSlot + 1) % slots.size();
+  }
+}
+
+void FrameHud::report() const {
+  std::cout << "HUD: " << missedVblanks << " vblanks missed in " << framesTimed << " frame intervals";
+  if (gpuFrames > 0) {
+    std::cout << ", overlay GPU time mean " << hudTimeTotal / gpuFrames * 1e3 << " ms, max "
+      << hudTimeMax * 1e3 << " ms";
+  }
+  std::cout << ", " << stalls << " frames waited for timestamps" << std::endl;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// On-screen overlay of frame pacing, drawn into the window after the scene.  It graphs the last
+// History frame intervals measured on the CPU and the GPU time of the scene, against a line at the
+// refresh period, and shows the current frame rate, the torn frames found by the row checksums and the
+// vblanks missed.  A vblank counts as missed for each refresh period beyond the first that a frame
+// interval spans, which is only meaningful when swaps are synchronized to the display.
+//
+// Everything, text included, is drawn with one instanced draw of quads (OpenGL 3.3): solid quads for
+// the background and graph bars, and glyph quads that look up a built-in 5x7 font.  The GPU times
+// come from timestamp queries that are read back a few frames late, as is the overlay's own GPU
+// time, which is reported at exit.
+
+class FrameHud {
+public:
+  // width and height are the size of the window, refreshRate the display's in Hz.  Throws
+  // std::runtime_error if the shaders cannot be built.
+  FrameHud(int width, int height, double refreshRate);
+  ~FrameHud();
+
+  // Call at the start of each frame, before any of its rendering.
+  void beginFrame();
+
+  // Call when the window's size changes.
+  void setSize(int width, int height);
+
+  // Call when the display's refresh rate changes, for the frames that follow.
+  void setRefreshRate(double refreshRate) { refreshPeriod = 1.0 / refreshRate; }
+
+  // Number of torn frames to show.  Until this is called the count is shown as unknown.
+  void setTornFrames(size_t frames);
+
+  // Draw the overlay into the currently bound draw framebuffer.  Restores the program and depth test.
+  void draw();
+
+  // Print the overlay's cost and the vblanks missed.
+  void report() const;
+
+  // Number of frames graphed.
+  static const size_t History = 300;
+
+private:
+  FrameHud(const FrameHud&) = delete;
+  FrameHud& operator=(const FrameHud&) = delete;
+
+  // Position and size in pixels from the top left, color, and glyph index or -1 for a solid quad.
+  struct Quad {
+    float rect[4];
+    uint8_t color[4];
+    float glyph;
+  };
+  void addQuad(float x, float y, float w, float h, const uint8_t color[4], float glyph = -1);
+  void addText(float x, float y, const char* text, const uint8_t color[4]);
+
+  // Timestamps at the start of a frame, before the overlay and after it.
+  struct Slot {
+    std::array<GLuint, 3> queries = {{0, 0, 0}};
+    bool issued = false;
+  };
+  void consume(Slot& slot);
+
+  int width;
+  int height;
+  double refreshPeriod;
+  float scale;
+  GLuint program = 0;
+  GLint viewportSizeUniform = -1;
+  GLuint fontTexture = 0;
+  GLuint vertexArray = 0;
+  GLuint instanceBuffer = 0;
+  std::vector<Quad> quads;
+
+  std::vector<Slot> slots;
+  size_t nextSlot = 0;
+  Slot* current = nullptr;
+
+  // Frame intervals and GPU times in seconds, oldest first once the ring has wrapped.
+  std::vector<float> cpuTimes;
+  std::vector<float> gpuTimes;
+  size_t cpuNext = 0;
+  size_t gpuNext = 0;
+  std::chrono::steady_clock::time_point lastFrame;
+  bool started = false;
+
+  bool haveTornFrames = false;
+  size_t tornFrames = 0;
+  size_t framesTimed = 0;
+  uint64_t missedVblanks = 0;
+  size_t gpuFrames = 0;
+  double hudTimeTotal = 0;
+  double hudTimeMax = 0;
+  size_t stalls = 0;
+};
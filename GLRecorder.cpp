@@ -0,0 +1,660 @@
+#define GLRECORDER_NO_REDIRECT
+#include "GLRecorder.h"
+#include <cstring>
+#include <stdexcept>
+
+GLRecorder* GLRecorder::current = nullptr;
+
+// The stream is written out whenever this much has been recorded.
+static const size_t FlushBytes = 16 * 1024 * 1024;
+
+GLRecorder::GLRecorder(const std::string& fileName, int width, int height)
+  : out(fileName, std::ios::binary) {
+  if (!out) {
+    throw std::runtime_error("Could not write GL stream " + fileName);
+  }
+  GLStreamHeader header;
+  std::memcpy(header.magic, GLStreamMagic, sizeof(header.magic));
+  header.version = GLStreamVersion;
+  header.width = width;
+  header.height = height;
+  header.reserved = 0;
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  bytes = sizeof(header);
+}
+
+GLRecorder::~GLRecorder() {
+  if (current == this) {
+    current = nullptr;
+  }
+  flush();
+}
+
+void GLRecorder::endFrame() {
+  call(GLCall::EndFrame);
+  frames++;
+  if (buffer.size() >= FlushBytes) {
+    flush();
+  }
+}
+
+void GLRecorder::flush() {
+  out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+  bytes += buffer.size();
+  buffer.clear();
+}
+
+void GLRecorder::putData(const void* data, size_t size) {
+  put<uint64_t>(data ? size : 0);
+  if (data) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    buffer.insert(buffer.end(), p, p + size);
+  }
+}
+
+void GLRecorder::putString(const char* text, size_t length) {
+  put<uint32_t>(static_cast<uint32_t>(length));
+  buffer.insert(buffer.end(), text, text + length);
+}
+
+//================================================================================================
+// The wrappers.  Pointers into bound buffer objects are recorded as offsets.
+
+namespace {
+  // Size of the pixels passed to glTexImage2D, for the formats and types the renderer uses, with rows
+  // padded to the default unpack alignment of 4.
+  size_t imageBytes(GLsizei width, GLsizei height, GLenum format, GLenum type) {
+    size_t components = 4;
+    switch (format) {
+      case GL_RED: case GL_DEPTH_COMPONENT: components = 1; break;
+      case GL_RG: components = 2; break;
+      case GL_RGB: case GL_BGR: components = 3; break;
+    }
+    size_t componentBytes = (type == GL_UNSIGNED_BYTE || type == GL_BYTE) ? 1 :
+      (type == GL_UNSIGNED_SHORT || type == GL_SHORT || type == GL_HALF_FLOAT) ? 2 : 4;
+    size_t rowBytes = (components * componentBytes * width + 3) & ~static_cast<size_t>(3);
+    return rowBytes * height;
+  }
+
+  uint64_t offset(const void* pointer) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(pointer));
+  }
+
+  void putNames(GLRecorder* r, GLsizei n, const GLuint* names) {
+    r->put<int32_t>(n);
+    for (GLsizei i = 0; i < n; i++) {
+      r->put<uint32_t>(names[i]);
+    }
+  }
+}
+
+namespace GLRecord {
+  void ActiveTexture(GLenum texture) {
+    glActiveTexture(texture);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::ActiveTexture);
+      r->put<uint32_t>(texture);
+    }
+  }
+
+  void AttachShader(GLuint program, GLuint shader) {
+    glAttachShader(program, shader);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::AttachShader);
+      r->put<uint32_t>(program);
+      r->put<uint32_t>(shader);
+    }
+  }
+
+  void BindBuffer(GLenum target, GLuint buffer) {
+    glBindBuffer(target, buffer);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::BindBuffer);
+      r->put<uint32_t>(target);
+      r->put<uint32_t>(buffer);
+    }
+  }
+
+  void BindFramebuffer(GLenum target, GLuint framebuffer) {
+    glBindFramebuffer(target, framebuffer);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::BindFramebuffer);
+      r->put<uint32_t>(target);
+      r->put<uint32_t>(framebuffer);
+    }
+  }
+
+  void BindTexture(GLenum target, GLuint texture) {
+    glBindTexture(target, texture);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::BindTexture);
+      r->put<uint32_t>(target);
+      r->put<uint32_t>(texture);
+    }
+  }
+
+  void BindVertexArray(GLuint array) {
+    glBindVertexArray(array);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::BindVertexArray);
+      r->put<uint32_t>(array);
+    }
+  }
+
+  void BlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0,
+    GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) {
+    glBlitFramebuffer(srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1, mask, filter);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::BlitFramebuffer);
+      for (GLint v : { srcX0, srcY0, srcX1, srcY1, dstX0, dstY0, dstX1, dstY1 }) {
+        r->put<int32_t>(v);
+      }
+      r->put<uint32_t>(mask);
+      r->put<uint32_t>(filter);
+    }
+  }
+
+  void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+    glBufferData(target, size, data, usage);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::BufferData);
+      r->put<uint32_t>(target);
+      r->put<uint64_t>(static_cast<uint64_t>(size));
+      r->putData(data, static_cast<size_t>(size));
+      r->put<uint32_t>(usage);
+    }
+  }
+
+  GLenum CheckFramebufferStatus(GLenum target) {
+    GLenum status = glCheckFramebufferStatus(target);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CheckFramebufferStatus);
+      r->put<uint32_t>(target);
+    }
+    return status;
+  }
+
+  void Clear(GLbitfield mask) {
+    glClear(mask);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Clear);
+      r->put<uint32_t>(mask);
+    }
+  }
+
+  void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    glClearColor(red, green, blue, alpha);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::ClearColor);
+      for (GLfloat v : { red, green, blue, alpha }) {
+        r->put<float>(v);
+      }
+    }
+  }
+
+  void ClearDepth(GLdouble depth) {
+    glClearDepth(depth);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::ClearDepth);
+      r->put<double>(depth);
+    }
+  }
+
+  void ClipControl(GLenum origin, GLenum depth) {
+    glClipControl(origin, depth);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::ClipControl);
+      r->put<uint32_t>(origin);
+      r->put<uint32_t>(depth);
+    }
+  }
+
+  void CompileShader(GLuint shader) {
+    glCompileShader(shader);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CompileShader);
+      r->put<uint32_t>(shader);
+    }
+  }
+
+  void CreateBuffers(GLsizei n, GLuint* buffers) {
+    glCreateBuffers(n, buffers);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CreateBuffers);
+      putNames(r, n, buffers);
+    }
+  }
+
+  GLuint CreateProgram() {
+    GLuint program = glCreateProgram();
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CreateProgram);
+      r->put<uint32_t>(program);
+    }
+    return program;
+  }
+
+  GLuint CreateShader(GLenum type) {
+    GLuint shader = glCreateShader(type);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CreateShader);
+      r->put<uint32_t>(type);
+      r->put<uint32_t>(shader);
+    }
+    return shader;
+  }
+
+  void CreateTextures(GLenum target, GLsizei n, GLuint* textures) {
+    glCreateTextures(target, n, textures);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CreateTextures);
+      r->put<uint32_t>(target);
+      putNames(r, n, textures);
+    }
+  }
+
+  void CreateVertexArrays(GLsizei n, GLuint* arrays) {
+    glCreateVertexArrays(n, arrays);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::CreateVertexArrays);
+      putNames(r, n, arrays);
+    }
+  }
+
+  void DeleteBuffers(GLsizei n, const GLuint* buffers) {
+    glDeleteBuffers(n, buffers);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DeleteBuffers);
+      putNames(r, n, buffers);
+    }
+  }
+
+  void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers) {
+    glDeleteFramebuffers(n, framebuffers);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DeleteFramebuffers);
+      putNames(r, n, framebuffers);
+    }
+  }
+
+  void DeleteProgram(GLuint program) {
+    glDeleteProgram(program);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DeleteProgram);
+      r->put<uint32_t>(program);
+    }
+  }
+
+  void DeleteShader(GLuint shader) {
+    glDeleteShader(shader);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DeleteShader);
+      r->put<uint32_t>(shader);
+    }
+  }
+
+  void DeleteTextures(GLsizei n, const GLuint* textures) {
+    glDeleteTextures(n, textures);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DeleteTextures);
+      putNames(r, n, textures);
+    }
+  }
+
+  void DeleteVertexArrays(GLsizei n, const GLuint* arrays) {
+    glDeleteVertexArrays(n, arrays);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DeleteVertexArrays);
+      putNames(r, n, arrays);
+    }
+  }
+
+  void DepthFunc(GLenum func) {
+    glDepthFunc(func);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DepthFunc);
+      r->put<uint32_t>(func);
+    }
+  }
+
+  void Disable(GLenum cap) {
+    glDisable(cap);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Disable);
+      r->put<uint32_t>(cap);
+    }
+  }
+
+  void DisableVertexAttribArray(GLuint index) {
+    glDisableVertexAttribArray(index);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DisableVertexAttribArray);
+      r->put<uint32_t>(index);
+    }
+  }
+
+  void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+    glDrawArrays(mode, first, count);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DrawArrays);
+      r->put<uint32_t>(mode);
+      r->put<int32_t>(first);
+      r->put<int32_t>(count);
+    }
+  }
+
+  void DrawArraysIndirect(GLenum mode, const void* indirect) {
+    glDrawArraysIndirect(mode, indirect);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DrawArraysIndirect);
+      r->put<uint32_t>(mode);
+      r->put<uint64_t>(offset(indirect));
+    }
+  }
+
+  void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices) {
+    glDrawElements(mode, count, type, indices);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DrawElements);
+      r->put<uint32_t>(mode);
+      r->put<int32_t>(count);
+      r->put<uint32_t>(type);
+      r->put<uint64_t>(offset(indices));
+    }
+  }
+
+  void DrawElementsIndirect(GLenum mode, GLenum type, const void* indirect) {
+    glDrawElementsIndirect(mode, type, indirect);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::DrawElementsIndirect);
+      r->put<uint32_t>(mode);
+      r->put<uint32_t>(type);
+      r->put<uint64_t>(offset(indirect));
+    }
+  }
+
+  void Enable(GLenum cap) {
+    glEnable(cap);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Enable);
+      r->put<uint32_t>(cap);
+    }
+  }
+
+  void EnableVertexArrayAttrib(GLuint vaobj, GLuint index) {
+    glEnableVertexArrayAttrib(vaobj, index);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::EnableVertexArrayAttrib);
+      r->put<uint32_t>(vaobj);
+      r->put<uint32_t>(index);
+    }
+  }
+
+  void EnableVertexAttribArray(GLuint index) {
+    glEnableVertexAttribArray(index);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::EnableVertexAttribArray);
+      r->put<uint32_t>(index);
+    }
+  }
+
+  void Finish() {
+    glFinish();
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Finish);
+    }
+  }
+
+  void FramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) {
+    glFramebufferTexture2D(target, attachment, textarget, texture, level);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::FramebufferTexture2D);
+      r->put<uint32_t>(target);
+      r->put<uint32_t>(attachment);
+      r->put<uint32_t>(textarget);
+      r->put<uint32_t>(texture);
+      r->put<int32_t>(level);
+    }
+  }
+
+  void GenBuffers(GLsizei n, GLuint* buffers) {
+    glGenBuffers(n, buffers);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::GenBuffers);
+      putNames(r, n, buffers);
+    }
+  }
+
+  void GenFramebuffers(GLsizei n, GLuint* framebuffers) {
+    glGenFramebuffers(n, framebuffers);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::GenFramebuffers);
+      putNames(r, n, framebuffers);
+    }
+  }
+
+  void GenTextures(GLsizei n, GLuint* textures) {
+    glGenTextures(n, textures);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::GenTextures);
+      putNames(r, n, textures);
+    }
+  }
+
+  // Queries are replayed for their cost; the results are not recorded.
+  void GetIntegerv(GLenum pname, GLint* data) {
+    glGetIntegerv(pname, data);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::GetIntegerv);
+      r->put<uint32_t>(pname);
+    }
+  }
+
+  GLint GetUniformLocation(GLuint program, const GLchar* name) {
+    GLint location = glGetUniformLocation(program, name);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::GetUniformLocation);
+      r->put<uint32_t>(program);
+      r->putString(name, std::strlen(name));
+      r->put<int32_t>(location);
+    }
+    return location;
+  }
+
+  void LinkProgram(GLuint program) {
+    glLinkProgram(program);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::LinkProgram);
+      r->put<uint32_t>(program);
+    }
+  }
+
+  void NamedBufferStorage(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags) {
+    glNamedBufferStorage(buffer, size, data, flags);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::NamedBufferStorage);
+      r->put<uint32_t>(buffer);
+      r->put<uint64_t>(static_cast<uint64_t>(size));
+      r->putData(data, static_cast<size_t>(size));
+      r->put<uint32_t>(flags);
+    }
+  }
+
+  void PrimitiveRestartIndex(GLuint index) {
+    glPrimitiveRestartIndex(index);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::PrimitiveRestartIndex);
+      r->put<uint32_t>(index);
+    }
+  }
+
+  void ShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length) {
+    glShaderSource(shader, count, string, length);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::ShaderSource);
+      r->put<uint32_t>(shader);
+      r->put<int32_t>(count);
+      for (GLsizei i = 0; i < count; i++) {
+        r->putString(string[i], length && length[i] >= 0 ? static_cast<size_t>(length[i]) : std::strlen(string[i]));
+      }
+    }
+  }
+
+  void TexBuffer(GLenum target, GLenum internalformat, GLuint buffer) {
+    glTexBuffer(target, internalformat, buffer);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::TexBuffer);
+      r->put<uint32_t>(target);
+      r->put<uint32_t>(internalformat);
+      r->put<uint32_t>(buffer);
+    }
+  }
+
+  void TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+    GLint border, GLenum format, GLenum type, const void* pixels) {
+    glTexImage2D(target, level, internalformat, width, height, border, format, type, pixels);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::TexImage2D);
+      r->put<uint32_t>(target);
+      r->put<int32_t>(level);
+      r->put<int32_t>(internalformat);
+      r->put<int32_t>(width);
+      r->put<int32_t>(height);
+      r->put<int32_t>(border);
+      r->put<uint32_t>(format);
+      r->put<uint32_t>(type);
+      r->putData(pixels, imageBytes(width, height, format, type));
+    }
+  }
+
+  void TexParameteri(GLenum target, GLenum pname, GLint param) {
+    glTexParameteri(target, pname, param);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::TexParameteri);
+      r->put<uint32_t>(target);
+      r->put<uint32_t>(pname);
+      r->put<int32_t>(param);
+    }
+  }
+
+  void TextureBuffer(GLuint texture, GLenum internalformat, GLuint buffer) {
+    glTextureBuffer(texture, internalformat, buffer);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::TextureBuffer);
+      r->put<uint32_t>(texture);
+      r->put<uint32_t>(internalformat);
+      r->put<uint32_t>(buffer);
+    }
+  }
+
+  void Uniform1i(GLint location, GLint v0) {
+    glUniform1i(location, v0);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Uniform1i);
+      r->put<int32_t>(location);
+      r->put<int32_t>(v0);
+    }
+  }
+
+  void Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2) {
+    glUniform3f(location, v0, v1, v2);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Uniform3f);
+      r->put<int32_t>(location);
+      r->put<float>(v0);
+      r->put<float>(v1);
+      r->put<float>(v2);
+    }
+  }
+
+  void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value) {
+    glUniformMatrix4fv(location, count, transpose, value);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::UniformMatrix4fv);
+      r->put<int32_t>(location);
+      r->put<int32_t>(count);
+      r->put<uint8_t>(transpose);
+      for (GLsizei i = 0; i < 16 * count; i++) {
+        r->put<float>(value[i]);
+      }
+    }
+  }
+
+  void UseProgram(GLuint program) {
+    glUseProgram(program);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::UseProgram);
+      r->put<uint32_t>(program);
+    }
+  }
+
+  void VertexArrayAttribBinding(GLuint vaobj, GLuint attribindex, GLuint bindingindex) {
+    glVertexArrayAttribBinding(vaobj, attribindex, bindingindex);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::VertexArrayAttribBinding);
+      r->put<uint32_t>(vaobj);
+      r->put<uint32_t>(attribindex);
+      r->put<uint32_t>(bindingindex);
+    }
+  }
+
+  void VertexArrayAttribFormat(GLuint vaobj, GLuint attribindex, GLint size, GLenum type,
+    GLboolean normalized, GLuint relativeoffset) {
+    glVertexArrayAttribFormat(vaobj, attribindex, size, type, normalized, relativeoffset);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::VertexArrayAttribFormat);
+      r->put<uint32_t>(vaobj);
+      r->put<uint32_t>(attribindex);
+      r->put<int32_t>(size);
+      r->put<uint32_t>(type);
+      r->put<uint8_t>(normalized);
+      r->put<uint32_t>(relativeoffset);
+    }
+  }
+
+  void VertexArrayElementBuffer(GLuint vaobj, GLuint buffer) {
+    glVertexArrayElementBuffer(vaobj, buffer);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::VertexArrayElementBuffer);
+      r->put<uint32_t>(vaobj);
+      r->put<uint32_t>(buffer);
+    }
+  }
+
+  void VertexArrayVertexBuffer(GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride) {
+    glVertexArrayVertexBuffer(vaobj, bindingindex, buffer, offset, stride);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::VertexArrayVertexBuffer);
+      r->put<uint32_t>(vaobj);
+      r->put<uint32_t>(bindingindex);
+      r->put<uint32_t>(buffer);
+      r->put<uint64_t>(static_cast<uint64_t>(offset));
+      r->put<int32_t>(stride);
+    }
+  }
+
+  void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+    const void* pointer) {
+    glVertexAttribPointer(index, size, type, normalized, stride, pointer);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::VertexAttribPointer);
+      r->put<uint32_t>(index);
+      r->put<int32_t>(size);
+      r->put<uint32_t>(type);
+      r->put<uint8_t>(normalized);
+      r->put<int32_t>(stride);
+      r->put<uint64_t>(offset(pointer));
+    }
+  }
+
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    glViewport(x, y, width, height);
+    if (GLRecorder* r = GLRecorder::current) {
+      r->call(GLCall::Viewport);
+      r->put<int32_t>(x);
+      r->put<int32_t>(y);
+      r->put<int32_t>(width);
+      r->put<int32_t>(height);
+    }
+  }
+}
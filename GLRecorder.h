@@ -0,0 +1,335 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// Recording of the OpenGL calls the renderer makes, from the state setup in main() through each
+// frame's MeshPlane draws, into a compact binary stream that the GLReplay tool re-issues as fast as it
+// can.  Replaying the same calls without the renderer's own work separates driver overhead from ours.
+//
+// Only calls made in main.cpp are recorded: it includes this header last, which redirects the GL
+// functions below through wrappers that make the call and, while a recorder is current, append it to
+// the stream.  Calls made in other files (shader error checks, GPU culling, row checksums, ...) are not.
+//
+// The stream is a header followed by one record per call: a one-byte GLCall, then its arguments in
+// native byte order.  Enums, object names and integers are 32 bits, booleans 8, floats 32, doubles 64,
+// and buffer offsets 64.  Data is a 64-bit size (0 for a null pointer) and the bytes; strings are a
+// 32-bit length and the characters.  Object names and uniform locations are the recording's own; calls
+// that create them record the values returned so that the replayer can map them to its own.  Timer
+// queries, error checks and framebuffer readbacks are measurement, not rendering, and are not recorded.
+
+enum class GLCall : uint8_t {
+  EndFrame,             // Not a GL call: the end of a frame, after the renderer's glFinish
+  SwapBuffers,          // Not a GL call: where the renderer swapped buffers
+  ActiveTexture,
+  AttachShader,
+  BindBuffer,
+  BindFramebuffer,
+  BindTexture,
+  BindVertexArray,
+  BlitFramebuffer,
+  BufferData,
+  CheckFramebufferStatus,
+  Clear,
+  ClearColor,
+  ClearDepth,
+  ClipControl,
+  CompileShader,
+  CreateBuffers,
+  CreateProgram,
+  CreateShader,
+  CreateTextures,
+  CreateVertexArrays,
+  DeleteBuffers,
+  DeleteFramebuffers,
+  DeleteProgram,
+  DeleteShader,
+  DeleteTextures,
+  DeleteVertexArrays,
+  DepthFunc,
+  Disable,
+  DisableVertexAttribArray,
+  DrawArrays,
+  DrawArraysIndirect,
+  DrawElements,
+  DrawElementsIndirect,
+  Enable,
+  EnableVertexArrayAttrib,
+  EnableVertexAttribArray,
+  Finish,
+  FramebufferTexture2D,
+  GenBuffers,
+  GenFramebuffers,
+  GenTextures,
+  GetIntegerv,
+  GetUniformLocation,
+  LinkProgram,
+  NamedBufferStorage,
+  PrimitiveRestartIndex,
+  ShaderSource,
+  TexBuffer,
+  TexImage2D,
+  TexParameteri,
+  TextureBuffer,
+  Uniform1i,
+  Uniform3f,
+  UniformMatrix4fv,
+  UseProgram,
+  VertexArrayAttribBinding,
+  VertexArrayAttribFormat,
+  VertexArrayElementBuffer,
+  VertexArrayVertexBuffer,
+  VertexAttribPointer,
+  Viewport,
+  NumCalls
+};
+
+static const char GLStreamMagic[8] = { 'G', 'L', 'S', 'T', 'R', 'E', 'A', 'M' };
+static const uint32_t GLStreamVersion = 1;
+
+struct GLStreamHeader {
+  char magic[8];
+  uint32_t version;
+  int32_t width;          // Size of the recording's window
+  int32_t height;
+  uint32_t reserved;
+};
+
+class GLRecorder {
+public:
+  // Throws std::runtime_error if the file cannot be written.
+  GLRecorder(const std::string& fileName, int width, int height);
+  ~GLRecorder();
+
+  // Mark where the renderer swaps buffers, and the end of the frame.
+  void swapBuffers() { call(GLCall::SwapBuffers); }
+  void endFrame();
+
+  size_t getFrames() const { return frames; }
+  size_t getCalls() const { return calls; }
+  uint64_t getBytes() const { return bytes + buffer.size(); }
+
+  // Encoding used by the wrappers.
+  void call(GLCall c) {
+    buffer.push_back(static_cast<uint8_t>(c));
+    calls++;
+  }
+  template <class T> void put(T value) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+    buffer.insert(buffer.end(), p, p + sizeof(T));
+  }
+  void putData(const void* data, size_t size);
+  void putString(const char* text, size_t length);
+
+  // The recorder that the wrappers write to, or nullptr when not recording.
+  static GLRecorder* current;
+
+private:
+  GLRecorder(const GLRecorder&) = delete;
+  GLRecorder& operator=(const GLRecorder&) = delete;
+  void flush();
+
+  std::ofstream out;
+  std::vector<uint8_t> buffer;
+  size_t frames = 0;
+  size_t calls = 0;
+  uint64_t bytes = 0;
+};
+
+// Recording wrappers for the calls above.  Each makes the GL call and records it if a recorder is current.
+namespace GLRecord {
+  void ActiveTexture(GLenum texture);
+  void AttachShader(GLuint program, GLuint shader);
+  void BindBuffer(GLenum target, GLuint buffer);
+  void BindFramebuffer(GLenum target, GLuint framebuffer);
+  void BindTexture(GLenum target, GLuint texture);
+  void BindVertexArray(GLuint array);
+  void BlitFramebuffer(GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0,
+    GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter);
+  void BufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+  GLenum CheckFramebufferStatus(GLenum target);
+  void Clear(GLbitfield mask);
+  void ClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha);
+  void ClearDepth(GLdouble depth);
+  void ClipControl(GLenum origin, GLenum depth);
+  void CompileShader(GLuint shader);
+  void CreateBuffers(GLsizei n, GLuint* buffers);
+  GLuint CreateProgram();
+  GLuint CreateShader(GLenum type);
+  void CreateTextures(GLenum target, GLsizei n, GLuint* textures);
+  void CreateVertexArrays(GLsizei n, GLuint* arrays);
+  void DeleteBuffers(GLsizei n, const GLuint* buffers);
+  void DeleteFramebuffers(GLsizei n, const GLuint* framebuffers);
+  void DeleteProgram(GLuint program);
+  void DeleteShader(GLuint shader);
+  void DeleteTextures(GLsizei n, const GLuint* textures);
+  void DeleteVertexArrays(GLsizei n, const GLuint* arrays);
+  void DepthFunc(GLenum func);
+  void Disable(GLenum cap);
+  void DisableVertexAttribArray(GLuint index);
+  void DrawArrays(GLenum mode, GLint first, GLsizei count);
+  void DrawArraysIndirect(GLenum mode, const void* indirect);
+  void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices);
+  void DrawElementsIndirect(GLenum mode, GLenum type, const void* indirect);
+  void Enable(GLenum cap);
+  void EnableVertexArrayAttrib(GLuint vaobj, GLuint index);
+  void EnableVertexAttribArray(GLuint index);
+  void Finish();
+  void FramebufferTexture2D(GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level);
+  void GenBuffers(GLsizei n, GLuint* buffers);
+  void GenFramebuffers(GLsizei n, GLuint* framebuffers);
+  void GenTextures(GLsizei n, GLuint* textures);
+  void GetIntegerv(GLenum pname, GLint* data);
+  GLint GetUniformLocation(GLuint program, const GLchar* name);
+  void LinkProgram(GLuint program);
+  void NamedBufferStorage(GLuint buffer, GLsizeiptr size, const void* data, GLbitfield flags);
+  void PrimitiveRestartIndex(GLuint index);
+  void ShaderSource(GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length);
+  void TexBuffer(GLenum target, GLenum internalformat, GLuint buffer);
+  void TexImage2D(GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height,
+    GLint border, GLenum format, GLenum type, const void* pixels);
+  void TexParameteri(GLenum target, GLenum pname, GLint param);
+  void TextureBuffer(GLuint texture, GLenum internalformat, GLuint buffer);
+  void Uniform1i(GLint location, GLint v0);
+  void Uniform3f(GLint location, GLfloat v0, GLfloat v1, GLfloat v2);
+  void UniformMatrix4fv(GLint location, GLsizei count, GLboolean transpose, const GLfloat* value);
+  void UseProgram(GLuint program);
+  void VertexArrayAttribBinding(GLuint vaobj, GLuint attribindex, GLuint bindingindex);
+  void VertexArrayAttribFormat(GLuint vaobj, GLuint attribindex, GLint size, GLenum type,
+    GLboolean normalized, GLuint relativeoffset);
+  void VertexArrayElementBuffer(GLuint vaobj, GLuint buffer);
+  void VertexArrayVertexBuffer(GLuint vaobj, GLuint bindingindex, GLuint buffer, GLintptr offset, GLsizei stride);
+  void VertexAttribPointer(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride,
+    const void* pointer);
+  void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+}
+
+// Send the including file's calls through the wrappers.  GLRecorder.cpp and GLReplay.cpp define
+// GLRECORDER_NO_REDIRECT to make the real calls.
+#ifndef GLRECORDER_NO_REDIRECT
+#undef glActiveTexture
+#define glActiveTexture GLRecord::ActiveTexture
+#undef glAttachShader
+#define glAttachShader GLRecord::AttachShader
+#undef glBindBuffer
+#define glBindBuffer GLRecord::BindBuffer
+#undef glBindFramebuffer
+#define glBindFramebuffer GLRecord::BindFramebuffer
+#undef glBindTexture
+#define glBindTexture GLRecord::BindTexture
+#undef glBindVertexArray
+#define glBindVertexArray GLRecord::BindVertexArray
+#undef glBlitFramebuffer
+#define glBlitFramebuffer GLRecord::BlitFramebuffer
+#undef glBufferData
+#define glBufferData GLRecord::BufferData
+#undef glCheckFramebufferStatus
+#define glCheckFramebufferStatus GLRecord::CheckFramebufferStatus
+#undef glClear
+#define glClear GLRecord::Clear
+#undef glClearColor
+#define glClearColor GLRecord::ClearColor
+#undef glClearDepth
+#define glClearDepth GLRecord::ClearDepth
+#undef glClipControl
+#define glClipControl GLRecord::ClipControl
+#undef glCompileShader
+#define glCompileShader GLRecord::CompileShader
+#undef glCreateBuffers
+#define glCreateBuffers GLRecord::CreateBuffers
+#undef glCreateProgram
+#define glCreateProgram GLRecord::CreateProgram
+#undef glCreateShader
+#define glCreateShader GLRecord::CreateShader
+#undef glCreateTextures
+#define glCreateTextures GLRecord::CreateTextures
+#undef glCreateVertexArrays
+#define glCreateVertexArrays GLRecord::CreateVertexArrays
+#undef glDeleteBuffers
+#define glDeleteBuffers GLRecord::DeleteBuffers
+#undef glDeleteFramebuffers
+#define glDeleteFramebuffers GLRecord::DeleteFramebuffers
+#undef glDeleteProgram
+#define glDeleteProgram GLRecord::DeleteProgram
+#undef glDeleteShader
+#define glDeleteShader GLRecord::DeleteShader
+#undef glDeleteTextures
+#define glDeleteTextures GLRecord::DeleteTextures
+#undef glDeleteVertexArrays
+#define glDeleteVertexArrays GLRecord::DeleteVertexArrays
+#undef glDepthFunc
+#define glDepthFunc GLRecord::DepthFunc
+#undef glDisable
+#define glDisable GLRecord::Disable
+#undef glDisableVertexAttribArray
+#define glDisableVertexAttribArray GLRecord::DisableVertexAttribArray
+#undef glDrawArrays
+#define glDrawArrays GLRecord::DrawArrays
+#undef glDrawArraysIndirect
+#define glDrawArraysIndirect GLRecord::DrawArraysIndirect
+#undef glDrawElements
+#define glDrawElements GLRecord::DrawElements
+#undef glDrawElementsIndirect
+#define glDrawElementsIndirect GLRecord::DrawElementsIndirect
+#undef glEnable
+#define glEnable GLRecord::Enable
+#undef glEnableVertexArrayAttrib
+#define glEnableVertexArrayAttrib GLRecord::EnableVertexArrayAttrib
+#undef glEnableVertexAttribArray
+#define glEnableVertexAttribArray GLRecord::EnableVertexAttribArray
+#undef glFinish
+#define glFinish GLRecord::Finish
+#undef glFramebufferTexture2D
+#define glFramebufferTexture2D GLRecord::FramebufferTexture2D
+#undef glGenBuffers
+#define glGenBuffers GLRecord::GenBuffers
+#undef glGenFramebuffers
+#define glGenFramebuffers GLRecord::GenFramebuffers
+#undef glGenTextures
+#define glGenTextures GLRecord::GenTextures
+#undef glGetIntegerv
+#define glGetIntegerv GLRecord::GetIntegerv
+#undef glGetUniformLocation
+#define glGetUniformLocation GLRecord::GetUniformLocation
+#undef glLinkProgram
+#define glLinkProgram GLRecord::LinkProgram
+#undef glNamedBufferStorage
+#define glNamedBufferStorage GLRecord::NamedBufferStorage
+#undef glPrimitiveRestartIndex
+#define glPrimitiveRestartIndex GLRecord::PrimitiveRestartIndex
+#undef glShaderSource
+#define glShaderSource GLRecord::ShaderSource
+#undef glTexBuffer
+#define glTexBuffer GLRecord::TexBuffer
+#undef glTexImage2D
+#define glTexImage2D GLRecord::TexImage2D
+#undef glTexParameteri
+#define glTexParameteri GLRecord::TexParameteri
+#undef glTextureBuffer
+#define glTextureBuffer GLRecord::TextureBuffer
+#undef glUniform1i
+#define glUniform1i GLRecord::Uniform1i
+#undef glUniform3f
+#define glUniform3f GLRecord::Uniform3f
+#undef glUniformMatrix4fv
+#define glUniformMatrix4fv GLRecord::UniformMatrix4fv
+#undef glUseProgram
+#define glUseProgram GLRecord::UseProgram
+#undef glVertexArrayAttribBinding
+#define glVertexArrayAttribBinding GLRecord::VertexArrayAttribBinding
+#undef glVertexArrayAttribFormat
+#define glVertexArrayAttribFormat GLRecord::VertexArrayAttribFormat
+#undef glVertexArrayElementBuffer
+#define glVertexArrayElementBuffer GLRecord::VertexArrayElementBuffer
+#undef glVertexArrayVertexBuffer
+#define glVertexArrayVertexBuffer GLRecord::VertexArrayVertexBuffer
+#undef glVertexAttribPointer
+#define glVertexAttribPointer GLRecord::VertexAttribPointer
+#undef glViewport
+#define glViewport GLRecord::Viewport
+#endif
@@ -0,0 +1,552 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#define GLRECORDER_NO_REDIRECT
+#include "GLRecorder.h"
+#include <GLFW/glfw3.h>
+#include "MappedFile.h"
+
+//================================================================================================
+// Replays a GL call stream written by Reproduce_8K_Tearing --record, as fast as it can, to measure
+// what the driver costs for exactly the renderer's calls without any of the renderer's own work.
+// The whole stream is replayed once to create the objects and state, then the frames after the first
+// (which includes the mesh uploads) are replayed again --loops times and timed.  Swaps are made with
+// vsync off, so the frame rate is bounded by the driver and GPU rather than the display.
+
+static void usage(const char* name)
+{
+  std::cerr << "Usage: " << name << " <file.glstream> [--loops <n>] [--noSwap]" << std::endl;
+  std::cerr << "  --loops <n>    Times to replay the recorded frames after the first (default 10)" << std::endl;
+  std::cerr << "  --noSwap       Flush instead of swapping buffers, to leave presentation out" << std::endl;
+}
+
+// Decodes the records of a stream and makes the calls, mapping the recording's object names and
+// uniform locations to the ones this context returns.
+class Replayer {
+public:
+  Replayer(GLFWwindow* window, bool swap) : window(window), swap(swap) {}
+
+  // Replay the records in [begin, end).  If frameEnds is not null, the offset just after each frame's
+  // EndFrame record is appended to it.  Throws std::runtime_error on a malformed stream.
+  void replay(const uint8_t* begin, const uint8_t* end, std::vector<size_t>* frameEnds);
+
+  uint64_t getCalls() const { return calls; }
+  uint64_t getFrames() const { return frames; }
+
+private:
+  template <class T> T get() {
+    need(sizeof(T));
+    T value;
+    std::memcpy(&value, p, sizeof(T));
+    p += sizeof(T);
+    return value;
+  }
+  void need(size_t size) const {
+    if (static_cast<size_t>(end - p) < size) {
+      throw std::runtime_error("GL stream is truncated");
+    }
+  }
+  // Data stays in the mapped file; nullptr if none was recorded.
+  const void* getData() {
+    uint64_t size = get<uint64_t>();
+    need(static_cast<size_t>(size));
+    const void* data = size ? p : nullptr;
+    p += size;
+    return data;
+  }
+  std::string getString() {
+    uint32_t length = get<uint32_t>();
+    need(length);
+    std::string text(reinterpret_cast<const char*>(p), length);
+    p += length;
+    return text;
+  }
+  const void* getOffset() {
+    return reinterpret_cast<const void*>(static_cast<uintptr_t>(get<uint64_t>()));
+  }
+
+  // Recorded name to replayed name, growing the table for new names.
+  static GLuint& name(std::vector<GLuint>& names, GLuint recorded) {
+    if (recorded >= names.size()) { names.resize(recorded + 1, 0); }
+    return names[recorded];
+  }
+  GLuint buffer(GLuint n) { return name(buffers, n); }
+  GLuint texture(GLuint n) { return name(textures, n); }
+  GLuint framebuffer(GLuint n) { return name(framebuffers, n); }
+  GLuint vertexArray(GLuint n) { return name(vertexArrays, n); }
+  GLuint program(GLuint n) { return name(programs, n); }
+  GLint location(GLint recorded) {
+    if (recorded < 0 || currentProgram >= locations.size() ||
+        static_cast<size_t>(recorded) >= locations[currentProgram].size()) {
+      return -1;
+    }
+    return locations[currentProgram][recorded];
+  }
+
+  // Read a count and that many recorded names, for the generate and delete calls.
+  GLsizei getNames() {
+    GLsizei n = get<int32_t>();
+    if (n < 0 || static_cast<size_t>(n) > static_cast<size_t>(end - p) / sizeof(uint32_t)) {
+      throw std::runtime_error("GL stream is truncated");
+    }
+    recordedNames.resize(n);
+    replayedNames.resize(n);
+    for (GLsizei i = 0; i < n; i++) {
+      recordedNames[i] = get<uint32_t>();
+    }
+    return n;
+  }
+  void mapNames(std::vector<GLuint>& names) {
+    for (size_t i = 0; i < recordedNames.size(); i++) {
+      name(names, recordedNames[i]) = replayedNames[i];
+    }
+  }
+  void lookUpNames(std::vector<GLuint>& names) {
+    for (size_t i = 0; i < recordedNames.size(); i++) {
+      replayedNames[i] = name(names, recordedNames[i]);
+    }
+  }
+
+  GLFWwindow* window;
+  bool swap;
+  const uint8_t* p = nullptr;
+  const uint8_t* end = nullptr;
+
+  // Shaders and programs share a namespace.
+  std::vector<GLuint> buffers, textures, framebuffers, vertexArrays, programs;
+  std::vector< std::vector<GLint> > locations;    // By recorded program, then recorded location
+  GLuint currentProgram = 0;                      // Recorded name
+
+  std::vector<GLuint> recordedNames, replayedNames;
+  std::vector<float> floats;
+  uint64_t calls = 0;
+  uint64_t frames = 0;
+};
+
+void Replayer::replay(const uint8_t* begin, const uint8_t* end, std::vector<size_t>* frameEnds)
+{
+  const uint8_t* start = begin;
+  p = begin;
+  this->end = end;
+  while (p < end) {
+    GLCall c = static_cast<GLCall>(get<uint8_t>());
+    if (c != GLCall::EndFrame) { calls++; }
+    switch (c) {
+      case GLCall::EndFrame:
+        frames++;
+        if (frameEnds) { frameEnds->push_back(p - start); }
+        break;
+      case GLCall::SwapBuffers:
+        if (swap) { glfwSwapBuffers(window); } else { glFlush(); }
+        break;
+      case GLCall::ActiveTexture:
+        glActiveTexture(get<uint32_t>());
+        break;
+      case GLCall::AttachShader: {
+        GLuint prog = program(get<uint32_t>());
+        glAttachShader(prog, program(get<uint32_t>()));
+      } break;
+      case GLCall::BindBuffer: {
+        GLenum target = get<uint32_t>();
+        glBindBuffer(target, buffer(get<uint32_t>()));
+      } break;
+      case GLCall::BindFramebuffer: {
+        GLenum target = get<uint32_t>();
+        glBindFramebuffer(target, framebuffer(get<uint32_t>()));
+      } break;
+      case GLCall::BindTexture: {
+        GLenum target = get<uint32_t>();
+        glBindTexture(target, texture(get<uint32_t>()));
+      } break;
+      case GLCall::BindVertexArray:
+        glBindVertexArray(vertexArray(get<uint32_t>()));
+        break;
+      case GLCall::BlitFramebuffer: {
+        GLint v[8];
+        for (GLint& x : v) { x = get<int32_t>(); }
+        GLbitfield mask = get<uint32_t>();
+        glBlitFramebuffer(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], mask, get<uint32_t>());
+      } break;
+      case GLCall::BufferData: {
+        GLenum target = get<uint32_t>();
+        GLsizeiptr size = static_cast<GLsizeiptr>(get<uint64_t>());
+        const void* data = getData();
+        glBufferData(target, size, data, get<uint32_t>());
+      } break;
+      case GLCall::CheckFramebufferStatus:
+        glCheckFramebufferStatus(get<uint32_t>());
+        break;
+      case GLCall::Clear:
+        glClear(get<uint32_t>());
+        break;
+      case GLCall::ClearColor: {
+        GLfloat v[4];
+        for (GLfloat& x : v) { x = get<float>(); }
+        glClearColor(v[0], v[1], v[2], v[3]);
+      } break;
+      case GLCall::ClearDepth:
+        glClearDepth(get<double>());
+        break;
+      case GLCall::ClipControl: {
+        GLenum origin = get<uint32_t>();
+        glClipControl(origin, get<uint32_t>());
+      } break;
+      case GLCall::CompileShader:
+        glCompileShader(program(get<uint32_t>()));
+        break;
+      case GLCall::CreateBuffers: {
+        GLsizei n = getNames();
+        glCreateBuffers(n, replayedNames.data());
+        mapNames(buffers);
+      } break;
+      case GLCall::CreateProgram:
+        name(programs, get<uint32_t>()) = glCreateProgram();
+        break;
+      case GLCall::CreateShader: {
+        GLenum type = get<uint32_t>();
+        name(programs, get<uint32_t>()) = glCreateShader(type);
+      } break;
+      case GLCall::CreateTextures: {
+        GLenum target = get<uint32_t>();
+        GLsizei n = getNames();
+        glCreateTextures(target, n, replayedNames.data());
+        mapNames(textures);
+      } break;
+      case GLCall::CreateVertexArrays: {
+        GLsizei n = getNames();
+        glCreateVertexArrays(n, replayedNames.data());
+        mapNames(vertexArrays);
+      } break;
+      case GLCall::DeleteBuffers: {
+        GLsizei n = getNames();
+        lookUpNames(buffers);
+        glDeleteBuffers(n, replayedNames.data());
+      } break;
+      case GLCall::DeleteFramebuffers: {
+        GLsizei n = getNames();
+        lookUpNames(framebuffers);
+        glDeleteFramebuffers(n, replayedNames.data());
+      } break;
+      case GLCall::DeleteProgram:
+        glDeleteProgram(program(get<uint32_t>()));
+        break;
+      case GLCall::DeleteShader:
+        glDeleteShader(program(get<uint32_t>()));
+        break;
+      case GLCall::DeleteTextures: {
+        GLsizei n = getNames();
+        lookUpNames(textures);
+        glDeleteTextures(n, replayedNames.data());
+      } break;
+      case GLCall::DeleteVertexArrays: {
+        GLsizei n = getNames();
+        lookUpNames(vertexArrays);
+        glDeleteVertexArrays(n, replayedNames.data());
+      } break;
+      case GLCall::DepthFunc:
+        glDepthFunc(get<uint32_t>());
+        break;
+      case GLCall::Disable:
+        glDisable(get<uint32_t>());
+        break;
+      case GLCall::DisableVertexAttribArray:
+        glDisableVertexAttribArray(get<uint32_t>());
+        break;
+      case GLCall::DrawArrays: {
+        GLenum mode = get<uint32_t>();
+        GLint first = get<int32_t>();
+        glDrawArrays(mode, first, get<int32_t>());
+      } break;
+      case GLCall::DrawArraysIndirect: {
+        GLenum mode = get<uint32_t>();
+        glDrawArraysIndirect(mode, getOffset());
+      } break;
+      case GLCall::DrawElements: {
+        GLenum mode = get<uint32_t>();
+        GLsizei count = get<int32_t>();
+        GLenum type = get<uint32_t>();
+        glDrawElements(mode, count, type, getOffset());
+      } break;
+      case GLCall::DrawElementsIndirect: {
+        GLenum mode = get<uint32_t>();
+        GLenum type = get<uint32_t>();
+        glDrawElementsIndirect(mode, type, getOffset());
+      } break;
+      case GLCall::Enable:
+        glEnable(get<uint32_t>());
+        break;
+      case GLCall::EnableVertexArrayAttrib: {
+        GLuint array = vertexArray(get<uint32_t>());
+        glEnableVertexArrayAttrib(array, get<uint32_t>());
+      } break;
+      case GLCall::EnableVertexAttribArray:
+        glEnableVertexAttribArray(get<uint32_t>());
+        break;
+      case GLCall::Finish:
+        glFinish();
+        break;
+      case GLCall::FramebufferTexture2D: {
+        GLenum target = get<uint32_t>();
+        GLenum attachment = get<uint32_t>();
+        GLenum textarget = get<uint32_t>();
+        GLuint tex = texture(get<uint32_t>());
+        glFramebufferTexture2D(target, attachment, textarget, tex, get<int32_t>());
+      } break;
+      case GLCall::GenBuffers: {
+        GLsizei n = getNames();
+        glGenBuffers(n, replayedNames.data());
+        mapNames(buffers);
+      } break;
+      case GLCall::GenFramebuffers: {
+        GLsizei n = getNames();
+        glGenFramebuffers(n, replayedNames.data());
+        mapNames(framebuffers);
+      } break;
+      case GLCall::GenTextures: {
+        GLsizei n = getNames();
+        glGenTextures(n, replayedNames.data());
+        mapNames(textures);
+      } break;
+      case GLCall::GetIntegerv: {
+        GLint data[16];
+        glGetIntegerv(get<uint32_t>(), data);
+      } break;
+      case GLCall::GetUniformLocation: {
+        GLuint recordedProgram = get<uint32_t>();
+        std::string uniform = getString();
+        GLint recordedLocation = get<int32_t>();
+        GLint replayedLocation = glGetUniformLocation(program(recordedProgram), uniform.c_str());
+        if (recordedLocation >= 0) {
+          if (recordedProgram >= locations.size()) { locations.resize(recordedProgram + 1); }
+          std::vector<GLint>& programLocations = locations[recordedProgram];
+          if (static_cast<size_t>(recordedLocation) >= programLocations.size()) {
+            programLocations.resize(recordedLocation + 1, -1);
+          }
+          programLocations[recordedLocation] = replayedLocation;
+        }
+      } break;
+      case GLCall::LinkProgram:
+        glLinkProgram(program(get<uint32_t>()));
+        break;
+      case GLCall::NamedBufferStorage: {
+        GLuint buf = buffer(get<uint32_t>());
+        GLsizeiptr size = static_cast<GLsizeiptr>(get<uint64_t>());
+        const void* data = getData();
+        glNamedBufferStorage(buf, size, data, get<uint32_t>());
+      } break;
+      case GLCall::PrimitiveRestartIndex:
+        glPrimitiveRestartIndex(get<uint32_t>());
+        break;
+      case GLCall::ShaderSource: {
+        GLuint shader = program(get<uint32_t>());
+        GLsizei count = get<int32_t>();
+        std::vector<std::string> strings(count);
+        std::vector<const GLchar*> texts(count);
+        std::vector<GLint> lengths(count);
+        for (GLsizei i = 0; i < count; i++) {
+          strings[i] = getString();
+          texts[i] = strings[i].data();
+          lengths[i] = static_cast<GLint>(strings[i].size());
+        }
+        glShaderSource(shader, count, texts.data(), lengths.data());
+      } break;
+      case GLCall::TexBuffer: {
+        GLenum target = get<uint32_t>();
+        GLenum internalformat = get<uint32_t>();
+        glTexBuffer(target, internalformat, buffer(get<uint32_t>()));
+      } break;
+      case GLCall::TexImage2D: {
+        GLenum target = get<uint32_t>();
+        GLint level = get<int32_t>();
+        GLint internalformat = get<int32_t>();
+        GLsizei width = get<int32_t>();
+        GLsizei height = get<int32_t>();
+        GLint border = get<int32_t>();
+        GLenum format = get<uint32_t>();
+        GLenum type = get<uint32_t>();
+        glTexImage2D(target, level, internalformat, width, height, border, format, type, getData());
+      } break;
+      case GLCall::TexParameteri: {
+        GLenum target = get<uint32_t>();
+        GLenum pname = get<uint32_t>();
+        glTexParameteri(target, pname, get<int32_t>());
+      } break;
+      case GLCall::TextureBuffer: {
+        GLuint tex = texture(get<uint32_t>());
+        GLenum internalformat = get<uint32_t>();
+        glTextureBuffer(tex, internalformat, buffer(get<uint32_t>()));
+      } break;
+      case GLCall::Uniform1i: {
+        GLint loc = location(get<int32_t>());
+        glUniform1i(loc, get<int32_t>());
+      } break;
+      case GLCall::Uniform3f: {
+        GLint loc = location(get<int32_t>());
+        GLfloat v[3];
+        for (GLfloat& x : v) { x = get<float>(); }
+        glUniform3f(loc, v[0], v[1], v[2]);
+      } break;
+      case GLCall::UniformMatrix4fv: {
+        GLint loc = location(get<int32_t>());
+        GLsizei count = get<int32_t>();
+        GLboolean transpose = get<uint8_t>();
+        size_t size = 16 * static_cast<size_t>(count) * sizeof(float);
+        need(size);
+        floats.resize(16 * count);
+        std::memcpy(floats.data(), p, size);
+        p += size;
+        glUniformMatrix4fv(loc, count, transpose, floats.data());
+      } break;
+      case GLCall::UseProgram:
+        currentProgram = get<uint32_t>();
+        glUseProgram(program(currentProgram));
+        break;
+      case GLCall::VertexArrayAttribBinding: {
+        GLuint array = vertexArray(get<uint32_t>());
+        GLuint attribindex = get<uint32_t>();
+        glVertexArrayAttribBinding(array, attribindex, get<uint32_t>());
+      } break;
+      case GLCall::VertexArrayAttribFormat: {
+        GLuint array = vertexArray(get<uint32_t>());
+        GLuint attribindex = get<uint32_t>();
+        GLint size = get<int32_t>();
+        GLenum type = get<uint32_t>();
+        GLboolean normalized = get<uint8_t>();
+        glVertexArrayAttribFormat(array, attribindex, size, type, normalized, get<uint32_t>());
+      } break;
+      case GLCall::VertexArrayElementBuffer: {
+        GLuint array = vertexArray(get<uint32_t>());
+        glVertexArrayElementBuffer(array, buffer(get<uint32_t>()));
+      } break;
+      case GLCall::VertexArrayVertexBuffer: {
+        GLuint array = vertexArray(get<uint32_t>());
+        GLuint bindingindex = get<uint32_t>();
+        GLuint buf = buffer(get<uint32_t>());
+        GLintptr offset = static_cast<GLintptr>(get<uint64_t>());
+        glVertexArrayVertexBuffer(array, bindingindex, buf, offset, get<int32_t>());
+      } break;
+      case GLCall::VertexAttribPointer: {
+        GLuint index = get<uint32_t>();
+        GLint size = get<int32_t>();
+        GLenum type = get<uint32_t>();
+        GLboolean normalized = get<uint8_t>();
+        GLsizei stride = get<int32_t>();
+        glVertexAttribPointer(index, size, type, normalized, stride, getOffset());
+      } break;
+      case GLCall::Viewport: {
+        GLint x = get<int32_t>();
+        GLint y = get<int32_t>();
+        GLsizei width = get<int32_t>();
+        glViewport(x, y, width, get<int32_t>());
+      } break;
+      default:
+        throw std::runtime_error("Unknown call " + std::to_string(static_cast<unsigned>(c)) +
+          " in GL stream");
+    }
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string inputFile;
+  size_t loops = 10;
+  bool swap = true;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--loops" && i + 1 < argc) {
+      loops = std::stoul(argv[++i]);
+    } else if (arg == "--noSwap") {
+      swap = false;
+    } else if (arg[0] != '-' && inputFile.empty()) {
+      inputFile = arg;
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (inputFile.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    MappedFile file(inputFile, true);
+    GLStreamHeader header;
+    if (file.getSize() < sizeof(header)) {
+      throw std::runtime_error(inputFile + " is not a GL stream");
+    }
+    std::memcpy(&header, file.getData(), sizeof(header));
+    if (std::memcmp(header.magic, GLStreamMagic, sizeof(header.magic)) != 0) {
+      throw std::runtime_error(inputFile + " is not a GL stream");
+    }
+    if (header.version != GLStreamVersion) {
+      throw std::runtime_error(inputFile + " is GL stream version " + std::to_string(header.version) +
+        ", expected " + std::to_string(GLStreamVersion));
+    }
+    const uint8_t* records = file.getData() + sizeof(header);
+    const uint8_t* end = file.getData() + file.getSize();
+
+    glfwInit();
+    GLFWwindow* window = glfwCreateWindow(header.width, header.height, "GLReplay", nullptr, nullptr);
+    if (!window) {
+      std::cerr << "Failed to create GLFW window" << std::endl;
+      glfwTerminate();
+      return 2;
+    }
+    glfwMakeContextCurrent(window);
+    glewExperimental = true;
+    if (glewInit() != GLEW_OK) {
+      std::cerr << "Failed to initialize GLEW" << std::endl;
+      glfwTerminate();
+      return 3;
+    }
+    glGetError();
+    glfwSwapInterval(0);
+
+    // Replay everything once, which creates the objects and finds the frames.
+    Replayer replayer(window, swap);
+    std::vector<size_t> frameEnds;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    replayer.replay(records, end, &frameEnds);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Replayed " << replayer.getCalls() << " calls in " << frameEnds.size() << " frames in "
+      << elapsed.count() * 1e3 << " ms, including setup" << std::endl;
+
+    // Time the frames after the first, which hold only the per-frame calls.
+    if (frameEnds.size() < 2) {
+      std::cout << "Fewer than two frames recorded, nothing to time" << std::endl;
+    } else if (loops > 0) {
+      const uint8_t* first = records + frameEnds[0];
+      const uint8_t* last = records + frameEnds.back();
+      uint64_t calls = replayer.getCalls();
+      uint64_t frames = replayer.getFrames();
+      start = std::chrono::steady_clock::now();
+      for (size_t l = 0; l < loops && !glfwWindowShouldClose(window); l++) {
+        replayer.replay(first, last, nullptr);
+        glfwPollEvents();
+      }
+      elapsed = std::chrono::steady_clock::now() - start;
+      calls = replayer.getCalls() - calls;
+      frames = replayer.getFrames() - frames;
+      if (frames == 0) { frames = 1; }
+      std::cout << "Replayed " << frames << " frames (" << calls / frames << " calls each) in "
+        << elapsed.count() << " seconds" << std::endl;
+      std::cout << "Calls per second: " << calls / elapsed.count() << std::endl;
+      std::cout << "Frames per second: " << frames / elapsed.count() << std::endl;
+    }
+
+    glfwMakeContextCurrent(nullptr);
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 4;
+  }
+  return 0;
+}
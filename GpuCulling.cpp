@@ -0,0 +1,401 @@
+#include "GpuCulling.h"
+#include "ShaderUtils.h"
+#include <algorithm>
+#include <iostream>
+
+// Number of frames whose visible counts may be in flight; cull() drops the count rather than wait.
+static const size_t NumSlots = 4;
+
+// Threads per work group.
+static const GLuint GroupSize = 64;
+
+// One thread per instance.  An instance is culled when all four of its corners are outside the same
+// clip plane, which never culls a visible plane but may keep one that is just outside a frustum corner.
+// The occlusion test needs every corner in front of the eye, and compares window-space depths.
+static const GLchar* CullShader =
+R"(#version 430 core
+   layout(local_size_x = 64) in;
+   layout(std430, binding = 0) readonly buffer InstanceMatrices { mat4 instanceMatrix[]; };
+   layout(std430, binding = 2) writeonly buffer VisibleInstances { uint visibleInstance[]; };
+   layout(std430, binding = 3) buffer Command {
+      uint count; uint instanceCount; uint rest[3];
+      uint frustumCulled; uint occlusionCulled; uint occludedPixelsLow; uint occludedPixelsHigh;
+   };
+   layout(binding = 0) uniform sampler2D depthPyramid;
+   uniform mat4 viewProjection;
+   uniform vec4 bounds;
+   uniform bool reversedZ;
+   uniform uint numInstances;
+   uniform bool useDepthPyramid;
+   uniform vec2 viewport;
+
+   // Whether everything in the pixel rectangle is at least as near as the depth.  Level 0 of the
+   // pyramid covers 2x2 pixels per texel; use the first level where the rectangle spans two texels.
+   bool occluded(vec2 low, vec2 high, float nearest)
+   {
+      ivec2 p0 = ivec2(clamp(low, vec2(0), viewport - 1.0));
+      ivec2 p1 = ivec2(clamp(high, vec2(0), viewport - 1.0));
+      int level = 0;
+      int topLevel = textureQueryLevels(depthPyramid) - 1;
+      while (level < topLevel && any(greaterThan((p1 >> (level + 1)) - (p0 >> (level + 1)), ivec2(1)))) {
+         level++;
+      }
+      ivec2 t0 = p0 >> (level + 1);
+      ivec2 t1 = p1 >> (level + 1);
+      float a = texelFetch(depthPyramid, t0, level).r;
+      float b = texelFetch(depthPyramid, ivec2(t1.x, t0.y), level).r;
+      float c = texelFetch(depthPyramid, ivec2(t0.x, t1.y), level).r;
+      float d = texelFetch(depthPyramid, t1, level).r;
+      if (reversedZ) {
+         return nearest < min(min(a, b), min(c, d));
+      }
+      return nearest > max(max(a, b), max(c, d));
+   }
+
+   void main()
+   {
+      uint i = gl_GlobalInvocationID.x;
+      if (i >= numInstances) {
+         return;
+      }
+      mat4 m = viewProjection * instanceMatrix[i];
+      float nearDepth = reversedZ ? 0.0 : -1.0;
+      uint outside = 63u;
+      bool behindEye = false;
+      vec2 screen[4];
+      vec2 low = vec2(1e30);
+      vec2 high = vec2(-1e30);
+      float nearest = reversedZ ? 0.0 : 1.0;
+      for (int c = 0; c < 4; c++) {
+         vec4 p = m * vec4((c & 1) != 0 ? bounds.z : bounds.x, (c & 2) != 0 ? bounds.w : bounds.y, 0, 1);
+         uint o = 0u;
+         if (p.x < -p.w) { o |= 1u; }
+         if (p.x > p.w) { o |= 2u; }
+         if (p.y < -p.w) { o |= 4u; }
+         if (p.y > p.w) { o |= 8u; }
+         if (p.z < nearDepth * p.w) { o |= 16u; }
+         if (p.z > p.w) { o |= 32u; }
+         outside &= o;
+         if (p.w <= 0.0) {
+            behindEye = true;
+         } else {
+            vec3 ndc = p.xyz / p.w;
+            screen[c] = (ndc.xy * 0.5 + 0.5) * viewport;
+            low = min(low, screen[c]);
+            high = max(high, screen[c]);
+            float depth = reversedZ ? ndc.z : ndc.z * 0.5 + 0.5;
+            nearest = reversedZ ? max(nearest, depth) : min(nearest, depth);
+         }
+      }
+      if (outside != 0u) {
+         atomicAdd(frustumCulled, 1u);
+         return;
+      }
+      if (useDepthPyramid && !behindEye && occluded(low, high, nearest)) {
+         atomicAdd(occlusionCulled, 1u);
+
+         // Pixels the plane would have covered: the shoelace area of the quad, whose corners go around
+         // as 0, 1, 3, 2, limited to the on-screen part of its rectangle.
+         float area = 0.5 * abs(
+            screen[0].x * screen[1].y - screen[1].x * screen[0].y +
+            screen[1].x * screen[3].y - screen[3].x * screen[1].y +
+            screen[3].x * screen[2].y - screen[2].x * screen[3].y +
+            screen[2].x * screen[0].y - screen[0].x * screen[2].y);
+         vec2 extent = clamp(high, vec2(0), viewport) - clamp(low, vec2(0), viewport);
+         uint pixels = uint(min(area, extent.x * extent.y));
+         uint previous = atomicAdd(occludedPixelsLow, pixels);
+         if (previous + pixels < previous) {
+            atomicAdd(occludedPixelsHigh, 1u);
+         }
+         return;
+      }
+      visibleInstance[atomicAdd(instanceCount, 1u)] = i;
+   })";
+
+// Reduce 2x2 pixels of the depth buffer copy into each texel of pyramid level 0, keeping the farthest.
+// Odd sizes repeat the last row or column.
+static const GLchar* ReduceDepthShader =
+R"(#version 430 core
+   layout(local_size_x = 8, local_size_y = 8) in;
+   layout(binding = 0) uniform sampler2D depth;
+   layout(r32f, binding = 0) writeonly uniform image2D destination;
+   uniform bool reversedZ;
+   void main()
+   {
+      ivec2 d = ivec2(gl_GlobalInvocationID.xy);
+      if (any(greaterThanEqual(d, imageSize(destination)))) {
+         return;
+      }
+      ivec2 last = textureSize(depth, 0) - 1;
+      float a = texelFetch(depth, min(d * 2, last), 0).r;
+      float b = texelFetch(depth, min(d * 2 + ivec2(1, 0), last), 0).r;
+      float c = texelFetch(depth, min(d * 2 + ivec2(0, 1), last), 0).r;
+      float e = texelFetch(depth, min(d * 2 + ivec2(1, 1), last), 0).r;
+      float farthest = reversedZ ? min(min(a, b), min(c, e)) : max(max(a, b), max(c, e));
+      imageStore(destination, d, vec4(farthest));
+   })";
+
+// The same for each further level of the pyramid, from the level below.
+static const GLchar* ReducePyramidShader =
+R"(#version 430 core
+   layout(local_size_x = 8, local_size_y = 8) in;
+   layout(r32f, binding = 0) readonly uniform image2D source;
+   layout(r32f, binding = 1) writeonly uniform image2D destination;
+   uniform bool reversedZ;
+   void main()
+   {
+      ivec2 d = ivec2(gl_GlobalInvocationID.xy);
+      if (any(greaterThanEqual(d, imageSize(destination)))) {
+         return;
+      }
+      ivec2 last = imageSize(source) - 1;
+      float a = imageLoad(source, min(d * 2, last)).r;
+      float b = imageLoad(source, min(d * 2 + ivec2(1, 0), last)).r;
+      float c = imageLoad(source, min(d * 2 + ivec2(0, 1), last)).r;
+      float e = imageLoad(source, min(d * 2 + ivec2(1, 1), last)).r;
+      float farthest = reversedZ ? min(min(a, b), min(c, e)) : max(max(a, b), max(c, e));
+      imageStore(destination, d, vec4(farthest));
+   })";
+
+// Work group size of the reduction shaders in each direction.
+static const GLuint ReduceGroupSize = 8;
+
+GpuCulling::GpuCulling(const std::vector< std::array<float, 16> >& instanceMatrices,
+  const std::vector< std::array<float, 3> >& instanceColors, const std::array<float, 4>& bounds,
+  const std::array<GLuint, 5>& drawCommand, bool reversedZ)
+  : numInstances(instanceMatrices.size()), reversedZ(reversedZ), slots(NumSlots) {
+  command.fill(0);
+  std::copy(drawCommand.begin(), drawCommand.end(), command.begin());
+  // The culling shader counts the visible instances up from zero.
+  command[1] = 0;
+
+  program = linkProgram({ compileShader(GL_COMPUTE_SHADER, CullShader, "Culling shader compilation failed.") },
+    "Culling program link failed.");
+  viewProjectionUniform = glGetUniformLocation(program, "viewProjection");
+  useDepthPyramidUniform = glGetUniformLocation(program, "useDepthPyramid");
+  glProgramUniform4f(program, glGetUniformLocation(program, "bounds"), bounds[0], bounds[1], bounds[2], bounds[3]);
+  glProgramUniform1i(program, glGetUniformLocation(program, "reversedZ"), reversedZ ? 1 : 0);
+  glProgramUniform1ui(program, glGetUniformLocation(program, "numInstances"), static_cast<GLuint>(numInstances));
+
+  // The instance data never changes; the visible list and command are only written by the GPU.
+  std::vector<float> colors;
+  for (const auto& c : instanceColors) {
+    colors.insert(colors.end(), { c[0], c[1], c[2], 1.0f });
+  }
+  glGenBuffers(1, &matrixBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, matrixBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * 16 * numInstances, instanceMatrices.data(), GL_STATIC_DRAW);
+  glGenBuffers(1, &colorBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, colorBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(float) * colors.size(), colors.data(), GL_STATIC_DRAW);
+  glGenBuffers(1, &visibleBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * std::max<size_t>(numInstances, 1), nullptr, GL_DYNAMIC_COPY);
+  glGenBuffers(1, &commandBuffer);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+  glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(command), command.data(), GL_DYNAMIC_COPY);
+
+  for (Slot& slot : slots) {
+    glGenBuffers(1, &slot.buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(command), nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+GpuCulling::~GpuCulling() {
+  for (Slot& slot : slots) {
+    if (slot.fence) { glDeleteSync(slot.fence); }
+    glDeleteBuffers(1, &slot.buffer);
+  }
+  glDeleteBuffers(1, &matrixBuffer);
+  glDeleteBuffers(1, &colorBuffer);
+  glDeleteBuffers(1, &visibleBuffer);
+  glDeleteBuffers(1, &commandBuffer);
+  glDeleteProgram(program);
+  if (depthTexture) {
+    glDeleteTextures(1, &depthTexture);
+    glDeleteTextures(1, &pyramidTexture);
+    glDeleteProgram(reduceDepthProgram);
+    glDeleteProgram(reducePyramidProgram);
+  }
+}
+
+void GpuCulling::enableOcclusion(int width, int height) {
+  reduceDepthProgram = linkProgram({ compileShader(GL_COMPUTE_SHADER, ReduceDepthShader,
+    "Depth reduction shader compilation failed.") }, "Depth reduction program link failed.");
+  reducePyramidProgram = linkProgram({ compileShader(GL_COMPUTE_SHADER, ReducePyramidShader,
+    "Depth pyramid shader compilation failed.") }, "Depth pyramid program link failed.");
+  glProgramUniform1i(reduceDepthProgram, glGetUniformLocation(reduceDepthProgram, "reversedZ"), reversedZ ? 1 : 0);
+  glProgramUniform1i(reducePyramidProgram, glGetUniformLocation(reducePyramidProgram, "reversedZ"), reversedZ ? 1 : 0);
+  allocateDepthPyramid(width, height);
+}
+
+void GpuCulling::resizeOcclusion(int width, int height) {
+  if (!depthTexture || (width == this->width && height == this->height)) {
+    return;
+  }
+  glDeleteTextures(1, &depthTexture);
+  glDeleteTextures(1, &pyramidTexture);
+  allocateDepthPyramid(width, height);
+}
+
+void GpuCulling::allocateDepthPyramid(int width, int height) {
+  this->width = width;
+  this->height = height;
+  pyramidValid = false;
+  glProgramUniform2f(program, glGetUniformLocation(program, "viewport"),
+    static_cast<float>(width), static_cast<float>(height));
+
+  // Each level is half the size of the one below, rounded up, down to a single texel.
+  pyramidSizes.clear();
+  int w = width, h = height;
+  do {
+    w = (w + 1) / 2;
+    h = (h + 1) / 2;
+    pyramidSizes.push_back({{ w, h }});
+  } while (w > 1 || h > 1);
+
+  glGenTextures(1, &depthTexture);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glGenTextures(1, &pyramidTexture);
+  glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+  glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(pyramidSizes.size()), GL_R32F,
+    pyramidSizes[0][0], pyramidSizes[0][1]);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GpuCulling::buildDepthPyramid() {
+  if (!depthTexture) {
+    return;
+  }
+
+  // Copy the depth buffer, which stays on the GPU.
+  GLint drawFramebuffer = 0, readFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, depthTexture);
+  glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+  // Reduce it into each level in turn.
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  for (size_t level = 0; level < pyramidSizes.size(); level++) {
+    if (level == 0) {
+      glUseProgram(reduceDepthProgram);
+      glBindImageTexture(0, pyramidTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    } else {
+      glUseProgram(reducePyramidProgram);
+      glBindImageTexture(0, pyramidTexture, static_cast<GLint>(level - 1), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+      glBindImageTexture(1, pyramidTexture, static_cast<GLint>(level), GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+    }
+    glDispatchCompute((pyramidSizes[level][0] + ReduceGroupSize - 1) / ReduceGroupSize,
+      (pyramidSizes[level][1] + ReduceGroupSize - 1) / ReduceGroupSize, 1);
+    glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+  }
+  glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+  glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+  glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(previousProgram);
+  pyramidValid = true;
+}
+
+void GpuCulling::cull(const float viewProjection[16]) {
+  // Start from no visible instances and zero counters.
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+  glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(command), command.data());
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  glUseProgram(program);
+  glUniformMatrix4fv(viewProjectionUniform, 1, GL_FALSE, viewProjection);
+  glUniform1i(useDepthPyramidUniform, pyramidValid ? 1 : 0);
+  if (pyramidValid) {
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, pyramidTexture);
+  }
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, matrixBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, colorBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, visibleBuffer);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, commandBuffer);
+  glDispatchCompute(static_cast<GLuint>((numInstances + GroupSize - 1) / GroupSize), 1, 1);
+  glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, 0);
+  if (pyramidValid) {
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  glUseProgram(previousProgram);
+  framesCulled++;
+
+  // Copy the count and counters for the statistics, unless every slot is still waiting.
+  if (pending.size() == slots.size()) {
+    collect();
+  }
+  if (pending.size() < slots.size()) {
+    Slot& slot = slots[nextSlot];
+    glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, slot.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof(command));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pending.push_back(nextSlot);
+    nextSlot = (nextSlot + 1) % slots.size();
+  }
+}
+
+void GpuCulling::collect(bool wait) {
+  while (!pending.empty()) {
+    Slot& slot = slots[pending.front()];
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    consume(slot);
+    pending.pop_front();
+  }
+}
+
+void GpuCulling::consume(Slot& slot) {
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+
+  std::array<GLuint, CommandWords> result;
+  glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+  glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(result), result.data());
+  glBindBuffer(GL_COPY_READ_BUFFER, 0);
+  GLuint visible = result[1];
+  frustumCulledTotal += result[5];
+  occlusionCulledTotal += result[6];
+  occludedPixelsTotal += (static_cast<uint64_t>(result[8]) << 32) | result[7];
+
+  minVisible = framesCounted ? std::min(minVisible, static_cast<size_t>(visible)) : visible;
+  maxVisible = framesCounted ? std::max(maxVisible, static_cast<size_t>(visible)) : visible;
+  visibleTotal += visible;
+  framesCounted++;
+}
+
+void GpuCulling::report() const {
+  std::cout << "GPU culling: " << framesCulled << " frames of " << numInstances << " planes" << std::endl;
+  if (framesCounted) {
+    std::cout << "  Visible planes in " << framesCounted << " frames counted: mean " << getMeanVisible()
+      << ", min " << minVisible << ", max " << maxVisible << std::endl;
+    std::cout << "  Culled per frame: " << static_cast<double>(frustumCulledTotal) / framesCounted
+      << " outside the view";
+    if (isOcclusionEnabled()) {
+      std::cout << ", " << static_cast<double>(occlusionCulledTotal) / framesCounted << " occluded, saving about "
+        << static_cast<double>(occludedPixelsTotal) / framesCounted / 1e6 << " Mfragments";
+    }
+    std::cout << std::endl;
+  }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// GPU-driven frustum culling of many instances of one plane.  The instances' matrices and colors live
+// in shader storage buffers.  Each frame a compute shader (OpenGL 4.3) tests the four corners of every
+// instance against the frustum of the view-projection matrix and appends the visible instances to a
+// list, counting them with an atomic add straight into the instanceCount of an indirect draw command.
+// The CPU then submits that one command, so it does no per-plane work and never waits for the result.
+//
+// With occlusion culling enabled, the depth buffer of each finished frame is reduced into a
+// hierarchical-Z pyramid, each texel holding the farthest depth of the pixels it covers.  The next
+// frame's pass rejects any instance whose nearest depth is behind the farthest depth under its
+// screen rectangle, found from at most four texels of the pyramid level where the rectangle spans two.
+// Since the pyramid is a frame old, a plane uncovered by camera motion can appear a frame late.
+//
+// The draw shaders read the storage blocks at these bindings, which cull() leaves bound:
+//   0: mat4 instanceMatrix[]   model matrix of each instance, including any position mapping
+//   1: vec4 instanceColor[]    color of each instance
+//   2: uint visibleInstance[]  indices of the visible instances, indexed by gl_InstanceID
+//
+// The number of visible instances and the culling statistics are read back a few frames late through
+// fences, for reporting only.
+
+class GpuCulling {
+public:
+  // bounds are the x and y minima then maxima of the plane (at z = 0) in the coordinates that the
+  // instance matrices transform.  command is a DrawElementsIndirectCommand, or a DrawArraysIndirectCommand
+  // followed by an unused word, whose instanceCount is replaced by the number of visible instances.
+  // reversedZ selects the [0,1] clip-space depth range set by glClipControl with greater depths nearer.
+  // Throws std::runtime_error if the compute shaders cannot be built.
+  GpuCulling(const std::vector< std::array<float, 16> >& instanceMatrices,
+    const std::vector< std::array<float, 3> >& instanceColors, const std::array<float, 4>& bounds,
+    const std::array<GLuint, 5>& command, bool reversedZ);
+  ~GpuCulling();
+
+  // Also reject instances hidden behind the previous frame's depth, for a width x height viewport.
+  void enableOcclusion(int width, int height);
+  bool isOcclusionEnabled() const { return depthTexture != 0; }
+
+  // Fill the indirect command with the instances visible through the view-projection matrix.
+  void cull(const float viewProjection[16]);
+
+  // Reallocate the depth copy and pyramid for a new viewport size.  The next cull() does not test
+  // occlusion, since there is no pyramid of the new size until buildDepthPyramid() is called.
+  void resizeOcclusion(int width, int height);
+
+  // Build the depth pyramid from the depth buffer of the currently bound draw framebuffer, for the next
+  // cull().  Does nothing unless occlusion culling is enabled.
+  void buildDepthPyramid();
+
+  // Stop testing occlusion until the pyramid is next built, for when the depth buffer no longer matches it.
+  void invalidateDepthPyramid() { pyramidValid = false; }
+
+  // Buffer holding the indirect draw command written by cull().
+  GLuint getCommandBuffer() const { return commandBuffer; }
+  size_t getNumInstances() const { return numInstances; }
+
+  // Consume any results whose fences have signaled, waiting for all of them if wait is true.
+  void collect(bool wait = false);
+
+  // Print a summary of the frames culled.
+  void report() const;
+
+  // Mean number of visible instances over the frames collected so far.
+  double getMeanVisible() const { return framesCounted ? static_cast<double>(visibleTotal) / framesCounted : 0; }
+
+private:
+  GpuCulling(const GpuCulling&) = delete;
+  GpuCulling& operator=(const GpuCulling&) = delete;
+
+  // The command buffer holds the five words of the indirect command followed by counters of the
+  // instances outside the view and occluded, and the low then high words of the occluded instances'
+  // screen area.  cull() zeroes the counters.
+  static const size_t CommandWords = 9;
+
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = 0;
+  };
+  void consume(Slot& slot);
+  void allocateDepthPyramid(int width, int height);
+
+  size_t numInstances;
+  bool reversedZ;
+  std::array<GLuint, CommandWords> command;
+  GLuint program = 0;
+  GLint viewProjectionUniform = -1;
+  GLint useDepthPyramidUniform = -1;
+  GLuint matrixBuffer = 0;
+  GLuint colorBuffer = 0;
+  GLuint visibleBuffer = 0;
+  GLuint commandBuffer = 0;
+  std::vector<Slot> slots;
+  std::deque<size_t> pending;   // Indices of in-flight slots, oldest first
+  size_t nextSlot = 0;
+
+  // Occlusion culling: a copy of the depth buffer and the pyramid reduced from it, whose level 0 is
+  // half its size.
+  int width = 0;
+  int height = 0;
+  GLuint depthTexture = 0;
+  GLuint pyramidTexture = 0;
+  std::vector< std::array<int, 2> > pyramidSizes;
+  GLuint reduceDepthProgram = 0;
+  GLuint reducePyramidProgram = 0;
+  bool pyramidValid = false;
+
+  size_t framesCulled = 0;
+  size_t framesCounted = 0;
+  uint64_t visibleTotal = 0;
+  size_t minVisible = 0;
+  size_t maxVisible = 0;
+  uint64_t frustumCulledTotal = 0;
+  uint64_t occlusionCulledTotal = 0;
+  uint64_t occludedPixelsTotal = 0;
+};
@@ -0,0 +1,79 @@
+#include "Image.h"
+#include <cctype>
+#include <fstream>
+#include <stdexcept>
+
+void writePPM(const std::string& fileName, const Image& image) {
+  std::ofstream out(fileName, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("Could not open " + fileName + " for writing.");
+  }
+  out << "P6\n" << image.width << " " << image.height << "\n255\n";
+  std::vector<char> rgb(static_cast<size_t>(image.width) * 3);
+  for (int y = 0; y < image.height; y++) {
+    const uint8_t* src = image.row(y);
+    for (int x = 0; x < image.width; x++) {
+      rgb[x * 3 + 0] = static_cast<char>(src[x * 4 + 0]);
+      rgb[x * 3 + 1] = static_cast<char>(src[x * 4 + 1]);
+      rgb[x * 3 + 2] = static_cast<char>(src[x * 4 + 2]);
+    }
+    out.write(rgb.data(), rgb.size());
+  }
+  if (!out) {
+    throw std::runtime_error("Failed writing " + fileName);
+  }
+}
+
+// Read the next whitespace-separated header token, skipping # comments.
+static int readPPMHeaderValue(std::istream& in) {
+  while (in) {
+    int c = in.peek();
+    if (c == '#') {
+      std::string comment;
+      std::getline(in, comment);
+    } else if (isspace(c)) {
+      in.get();
+    } else {
+      break;
+    }
+  }
+  int value = -1;
+  in >> value;
+  return value;
+}
+
+Image readPPM(const std::string& fileName) {
+  std::ifstream in(fileName, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Could not open " + fileName + " for reading.");
+  }
+  std::string magic;
+  in >> magic;
+  if (magic != "P6") {
+    throw std::runtime_error(fileName + " is not a binary PPM file.");
+  }
+  int width = readPPMHeaderValue(in);
+  int height = readPPMHeaderValue(in);
+  int maxValue = readPPMHeaderValue(in);
+  if (width <= 0 || height <= 0 || maxValue != 255) {
+    throw std::runtime_error(fileName + " has an unsupported PPM header.");
+  }
+  in.get();   // Single whitespace character after the header.
+
+  Image image(width, height);
+  std::vector<char> rgb(static_cast<size_t>(width) * 3);
+  for (int y = 0; y < height; y++) {
+    in.read(rgb.data(), rgb.size());
+    if (!in) {
+      throw std::runtime_error(fileName + " is truncated.");
+    }
+    uint8_t* dst = image.row(y);
+    for (int x = 0; x < width; x++) {
+      dst[x * 4 + 0] = static_cast<uint8_t>(rgb[x * 3 + 0]);
+      dst[x * 4 + 1] = static_cast<uint8_t>(rgb[x * 3 + 1]);
+      dst[x * 4 + 2] = static_cast<uint8_t>(rgb[x * 3 + 2]);
+      dst[x * 4 + 3] = 255;
+    }
+  }
+  return image;
+}
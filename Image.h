@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "LargePages.h"
+
+//================================================================================================
+// 8-bit RGBA image stored with the top row first, used for CPU-rendered and captured frames.  The
+// pixels are a large array, allocated as configured by configureLargePages().
+
+struct Image {
+  Image() {}
+  Image(int width, int height) : width(width), height(height),
+    pixels(static_cast<size_t>(width) * height * 4) {}
+
+  uint8_t* row(int y) { return &pixels[static_cast<size_t>(y) * width * 4]; }
+  const uint8_t* row(int y) const { return &pixels[static_cast<size_t>(y) * width * 4]; }
+
+  int width = 0;
+  int height = 0;
+  LargePageVector<uint8_t> pixels;
+};
+
+// Write the image as a binary (P6) PPM file, dropping alpha.  Throws std::runtime_error on failure.
+void writePPM(const std::string& fileName, const Image& image);
+
+// Read a binary (P6) PPM file with 8-bit channels, setting alpha to 255.  Throws std::runtime_error
+// on failure.
+Image readPPM(const std::string& fileName);
@@ -0,0 +1,105 @@
+#include "ImageCompare.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define IMAGECOMPARE_SSE2 1
+#endif
+
+namespace {
+  // Accumulated statistics for the rows handled by one thread.
+  struct PartialResult {
+    uint8_t maxError[3] = {0, 0, 0};
+    uint64_t sumError[3] = {0, 0, 0};
+    size_t differingPixels = 0;
+  };
+
+  // Compare numPixels RGBA pixels starting at a and b, adding into result.
+  void compareRow(const uint8_t* a, const uint8_t* b, size_t numPixels, const std::array<int, 3>& tolerance,
+    PartialResult& result) {
+    // Differences are 0 to 255, so tolerances outside that range mean the same as its ends.
+    int limit[3];
+    for (int c = 0; c < 3; c++) {
+      limit[c] = std::min(std::max(tolerance[c], 0), 255);
+    }
+    size_t x = 0;
+#ifdef IMAGECOMPARE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tol = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(limit[0]) |
+      (static_cast<uint32_t>(limit[1]) << 8) | (static_cast<uint32_t>(limit[2]) << 16) | 0xff000000u));
+    const __m128i channelMask[3] = {
+      _mm_set1_epi32(0x000000ff), _mm_set1_epi32(0x0000ff00), _mm_set1_epi32(0x00ff0000)
+    };
+    __m128i maxDiff = zero;
+    __m128i sums[3] = { zero, zero, zero };
+    static const int bitCount[16] = { 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4 };
+    size_t differing = 0;
+    for (; x + 4 <= numPixels; x += 4) {
+      __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + x * 4));
+      __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + x * 4));
+      __m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+      maxDiff = _mm_max_epu8(maxDiff, diff);
+      for (int c = 0; c < 3; c++) {
+        sums[c] = _mm_add_epi64(sums[c], _mm_sad_epu8(_mm_and_si128(diff, channelMask[c]), zero));
+      }
+      // A pixel is within tolerance when no channel exceeds its limit.
+      __m128i within = _mm_cmpeq_epi32(_mm_subs_epu8(diff, tol), zero);
+      differing += 4 - bitCount[_mm_movemask_ps(_mm_castsi128_ps(within))];
+    }
+    uint8_t maxBytes[16];
+    uint64_t sumWords[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(maxBytes), maxDiff);
+    for (int c = 0; c < 3; c++) {
+      for (int p = 0; p < 4; p++) {
+        result.maxError[c] = std::max(result.maxError[c], maxBytes[p * 4 + c]);
+      }
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sumWords), sums[c]);
+      result.sumError[c] += sumWords[0] + sumWords[1];
+    }
+    result.differingPixels += differing;
+#endif
+    for (; x < numPixels; x++) {
+      bool differs = false;
+      for (int c = 0; c < 3; c++) {
+        int d = std::abs(static_cast<int>(a[x * 4 + c]) - static_cast<int>(b[x * 4 + c]));
+        result.maxError[c] = std::max(result.maxError[c], static_cast<uint8_t>(d));
+        result.sumError[c] += d;
+        differs = differs || d > limit[c];
+      }
+      if (differs) { result.differingPixels++; }
+    }
+  }
+}
+
+ImageComparison compareImages(const Image& image, const Image& golden, const std::array<int, 3>& tolerance,
+  unsigned numThreads) {
+  ImageComparison comparison;
+  comparison.sizesMatch = image.width == golden.width && image.height == golden.height;
+  if (!comparison.sizesMatch) {
+    return comparison;
+  }
+  comparison.totalPixels = static_cast<size_t>(image.width) * image.height;
+
+  if (numThreads == 0) { numThreads = defaultThreadCount(); }
+  std::vector<PartialResult> partials(numThreads);
+  parallelFor(static_cast<size_t>(image.height), numThreads, [&](size_t y, unsigned thread) {
+    compareRow(image.row(static_cast<int>(y)), golden.row(static_cast<int>(y)), image.width, tolerance,
+      partials[thread]);
+  });
+
+  for (const PartialResult& p : partials) {
+    for (int c = 0; c < 3; c++) {
+      comparison.maxError[c] = std::max(comparison.maxError[c], static_cast<int>(p.maxError[c]));
+      comparison.meanError[c] += static_cast<double>(p.sumError[c]);
+    }
+    comparison.differingPixels += p.differingPixels;
+  }
+  for (int c = 0; c < 3; c++) {
+    comparison.meanError[c] /= comparison.totalPixels ? comparison.totalPixels : 1;
+  }
+  return comparison;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include "Image.h"
+
+//================================================================================================
+// Comparison of captured frames against stored golden images.  Rows are compared in parallel using
+// SSE2 on four RGBA pixels at a time, so 8K frames take milliseconds.  Alpha is ignored.
+
+struct ImageComparison {
+  bool sizesMatch = false;
+  std::array<int, 3> maxError = {{0, 0, 0}};          // Largest absolute difference per channel
+  std::array<double, 3> meanError = {{0, 0, 0}};      // Mean absolute difference per channel
+  size_t differingPixels = 0;                         // Pixels with any channel above its tolerance
+  size_t totalPixels = 0;
+};
+
+// Compare two images with a per-channel (R, G, B) tolerance.  numThreads of 0 uses one thread per
+// hardware thread.
+ImageComparison compareImages(const Image& image, const Image& golden, const std::array<int, 3>& tolerance,
+  unsigned numThreads = 0);
@@ -0,0 +1,179 @@
+#include "LargePages.h"
+#include <atomic>
+#include <cstdio>
+#include <string>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#elif !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+// Size and alignment of the huge pages the mappings are made of.
+static const size_t HugePageSize = 2 * 1024 * 1024;
+
+static LargePageMode largePageMode = LargePageMode::Off;
+static int largePageNode = -1;
+
+static std::atomic<uint64_t> explicitBytes(0);
+static std::atomic<uint64_t> transparentBytes(0);
+static std::atomic<uint64_t> mappedBytes(0);
+static std::atomic<size_t> explicitFailures(0);
+static std::atomic<size_t> bindFailures(0);
+
+void configureLargePages(LargePageMode mode, int numaNode) {
+  largePageMode = mode;
+  largePageNode = numaNode;
+}
+
+int numaNodeOfCpu(int cpu) {
+#ifdef __linux__
+  if (cpu < 0) {
+    unsigned currentCpu = 0, node = 0;
+    if (syscall(SYS_getcpu, &currentCpu, &node, nullptr) != 0) {
+      return -1;
+    }
+    return static_cast<int>(node);
+  }
+  // The CPU's directory in sysfs has a link to its node.
+  std::string path = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+  DIR* dir = opendir(path.c_str());
+  if (!dir) {
+    return -1;
+  }
+  int node = -1;
+  while (dirent* entry = readdir(dir)) {
+    if (std::sscanf(entry->d_name, "node%d", &node) == 1) {
+      break;
+    }
+    node = -1;
+  }
+  closedir(dir);
+  return node;
+#else
+  (void)cpu;
+  return -1;
+#endif
+}
+
+#ifdef __linux__
+// Whether an allocation of this size is mapped directly.  allocateLarge() and freeLarge() must agree.
+static bool isMapped(size_t bytes) {
+  return bytes >= LargeAllocationThreshold && (largePageMode != LargePageMode::Off || largePageNode >= 0);
+}
+
+static size_t mappedSize(size_t bytes) {
+  return (bytes + HugePageSize - 1) / HugePageSize * HugePageSize;
+}
+
+// Map size bytes aligned to a huge page by trimming an oversized mapping.
+static void* mapAligned(size_t size) {
+  size_t padded = size + HugePageSize;
+  void* p = mmap(nullptr, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+  uintptr_t start = reinterpret_cast<uintptr_t>(p);
+  uintptr_t aligned = (start + HugePageSize - 1) / HugePageSize * HugePageSize;
+  if (aligned > start) {
+    munmap(p, aligned - start);
+  }
+  size_t tail = start + padded - (aligned + size);
+  if (tail > 0) {
+    munmap(reinterpret_cast<void*>(aligned + size), tail);
+  }
+  return reinterpret_cast<void*>(aligned);
+}
+#endif
+
+void* allocateLarge(size_t bytes) {
+#ifdef __linux__
+  if (isMapped(bytes)) {
+    size_t size = mappedSize(bytes);
+    void* p = nullptr;
+    bool advise = largePageMode == LargePageMode::Transparent;
+    if (largePageMode == LargePageMode::Explicit) {
+      p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED) {
+        p = nullptr;
+        explicitFailures++;
+        advise = true;
+      }
+    }
+    bool isExplicit = p != nullptr;
+    if (!p) {
+      p = mapAligned(size);
+      if (!p) {
+        throw std::bad_alloc();
+      }
+      if (advise) {
+        madvise(p, size, MADV_HUGEPAGE);
+      }
+    }
+
+    // Bind before the pages are first touched, which is when they are placed.
+    if (largePageNode >= 0) {
+      unsigned long mask[16] = {};
+      if (static_cast<size_t>(largePageNode) < sizeof(mask) * 8) {
+        mask[largePageNode / (sizeof(unsigned long) * 8)] |= 1UL << (largePageNode % (sizeof(unsigned long) * 8));
+      }
+      if (syscall(SYS_mbind, p, size, MPOL_PREFERRED, mask, sizeof(mask) * 8, 0) != 0) {
+        bindFailures++;
+      }
+    }
+
+    if (isExplicit) {
+      explicitBytes += size;
+    } else if (advise) {
+      transparentBytes += size;
+    } else {
+      mappedBytes += size;
+    }
+    return p;
+  }
+#endif
+  return ::operator new(bytes);
+}
+
+void freeLarge(void* p, size_t bytes) {
+  if (!p) {
+    return;
+  }
+#ifdef __linux__
+  if (isMapped(bytes)) {
+    munmap(p, mappedSize(bytes));
+    return;
+  }
+#endif
+  ::operator delete(p);
+}
+
+LargePageStats getLargePageStats() {
+  LargePageStats stats;
+  stats.explicitBytes = explicitBytes;
+  stats.transparentBytes = transparentBytes;
+  stats.mappedBytes = mappedBytes;
+  stats.explicitFailures = explicitFailures;
+  stats.bindFailures = bindFailures;
+  return stats;
+}
+
+PageFaults readPageFaults() {
+  PageFaults faults;
+#ifndef _WIN32
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    faults.minor = static_cast<uint64_t>(usage.ru_minflt);
+    faults.major = static_cast<uint64_t>(usage.ru_majflt);
+  }
+#endif
+  return faults;
+}
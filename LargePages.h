@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+//================================================================================================
+// Allocation of the large CPU-side arrays (mesh vertices, colors and indices, captured frames) in
+// huge pages and on the render thread's NUMA node.  With millions of triangles per plane, filling
+// those arrays in 4 KB pages costs hundreds of thousands of page faults, and on a multi-socket host
+// the pages may land on a node remote from the thread that reads them.
+//
+// Allocations of at least LargeAllocationThreshold bytes are mapped directly, 2 MB aligned, and:
+//   Explicit:     come from the hugetlbfs pool (MAP_HUGETLB), which must have been reserved, e.g. with
+//                 vm.nr_hugepages; when the pool is short they fall back to Transparent.
+//   Transparent:  are marked with MADV_HUGEPAGE so the kernel backs them with huge pages if it can.
+//   Off:          use normal pages; they are still mapped directly if a NUMA node is set.
+// If a node is set they are bound to it, preferring it over other nodes rather than failing.  Smaller
+// allocations, and all of them when huge pages are off and no node is set, use operator new.  Huge
+// pages and NUMA binding are only supported on Linux; elsewhere everything uses operator new.
+
+enum class LargePageMode { Off, Transparent, Explicit };
+
+// Choose how large arrays are allocated.  numaNode is -1 to not bind them.  Must be called before any
+// LargePageAllocator allocation is made, since the way an array is freed depends on the settings.
+void configureLargePages(LargePageMode mode, int numaNode);
+
+// NUMA node of the specified logical CPU, or of the one the calling thread is running on if cpu is
+// negative.  Returns -1 if it cannot be determined.
+int numaNodeOfCpu(int cpu);
+
+void* allocateLarge(size_t bytes);
+void freeLarge(void* p, size_t bytes);
+
+struct LargePageStats {
+  uint64_t explicitBytes = 0;      // In hugetlbfs pages
+  uint64_t transparentBytes = 0;   // Advised to use transparent huge pages
+  uint64_t mappedBytes = 0;        // Mapped directly with normal pages, for NUMA binding
+  size_t explicitFailures = 0;     // Explicit allocations that fell back to transparent
+  size_t bindFailures = 0;         // Allocations that could not be bound to the node
+};
+// Totals of the large allocations made so far, including ones since freed.
+LargePageStats getLargePageStats();
+
+// Page faults taken by the process so far.  Zero where not supported.
+struct PageFaults {
+  uint64_t minor = 0;
+  uint64_t major = 0;
+};
+PageFaults readPageFaults();
+
+static const size_t LargeAllocationThreshold = 2 * 1024 * 1024;
+
+// Standard allocator that goes through allocateLarge(), for std::vector.
+template <class T> struct LargePageAllocator {
+  typedef T value_type;
+  LargePageAllocator() {}
+  template <class U> LargePageAllocator(const LargePageAllocator<U>&) {}
+  T* allocate(size_t n) {
+    if (n > static_cast<size_t>(-1) / sizeof(T)) { throw std::bad_alloc(); }
+    return static_cast<T*>(allocateLarge(n * sizeof(T)));
+  }
+  void deallocate(T* p, size_t n) { freeLarge(p, n * sizeof(T)); }
+};
+template <class T, class U> bool operator==(const LargePageAllocator<T>&, const LargePageAllocator<U>&) { return true; }
+template <class T, class U> bool operator!=(const LargePageAllocator<T>&, const LargePageAllocator<U>&) { return false; }
+
+template <class T> using LargePageVector = std::vector<T, LargePageAllocator<T>>;
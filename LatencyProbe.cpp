@@ -0,0 +1,113 @@
+#include "LatencyProbe.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Side of the marker square in pixels on a 1080-line display, scaled with the height.
+static const int MarkerSize = 32;
+
+LatencyProbe::LatencyProbe(GLFWwindow* window, int width, int height, const std::string& mode)
+  : window(window), width(width), height(height) {
+  setSize(width, height);
+  glfwSetWindowUserPointer(window, this);
+  previousKeyCallback = glfwSetKeyCallback(window, keyCallback);
+  previousMouseButtonCallback = glfwSetMouseButtonCallback(window, mouseButtonCallback);
+  setMode(mode);
+}
+
+LatencyProbe::~LatencyProbe() {
+  glfwSetKeyCallback(window, previousKeyCallback);
+  glfwSetMouseButtonCallback(window, previousMouseButtonCallback);
+  glfwSetWindowUserPointer(window, nullptr);
+}
+
+void LatencyProbe::setSize(int width, int height) {
+  this->width = width;
+  this->height = height;
+  markerSize = MarkerSize * std::max(1, static_cast<int>(std::lround(height / 1080.0)));
+}
+
+void LatencyProbe::setMode(const std::string& newMode) {
+  mode = newMode;
+  if (latencies.find(mode) == latencies.end()) {
+    latencies[mode];
+    modeOrder.push_back(mode);
+  }
+}
+
+void LatencyProbe::keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+  LatencyProbe* probe = static_cast<LatencyProbe*>(glfwGetWindowUserPointer(window));
+  if (action == GLFW_PRESS) {
+    probe->event();
+  }
+  if (probe->previousKeyCallback) {
+    probe->previousKeyCallback(window, key, scancode, action, mods);
+  }
+}
+
+void LatencyProbe::mouseButtonCallback(GLFWwindow* window, int button, int action, int mods) {
+  LatencyProbe* probe = static_cast<LatencyProbe*>(glfwGetWindowUserPointer(window));
+  if (action == GLFW_PRESS) {
+    probe->event();
+  }
+  if (probe->previousMouseButtonCallback) {
+    probe->previousMouseButtonCallback(window, button, action, mods);
+  }
+}
+
+void LatencyProbe::event() {
+  pending.push_back(std::chrono::steady_clock::now());
+}
+
+void LatencyProbe::drawMarker() {
+  if (!pending.empty()) {
+    marker = !marker;
+    inFrame.insert(inFrame.end(), pending.begin(), pending.end());
+    pending.clear();
+  }
+  float level = marker ? 1.0f : 0.0f;
+  glEnable(GL_SCISSOR_TEST);
+  glScissor(width - markerSize, height - markerSize, markerSize, markerSize);
+  glClearColor(level, level, level, 1.0f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  glDisable(GL_SCISSOR_TEST);
+}
+
+void LatencyProbe::swapped() {
+  swapTime = std::chrono::steady_clock::now();
+}
+
+void LatencyProbe::completed() {
+  if (inFrame.empty()) {
+    return;
+  }
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  Latencies& l = latencies[mode];
+  for (const auto& t : inFrame) {
+    l.toSwap.push_back(std::chrono::duration<double>(swapTime - t).count());
+    l.toComplete.push_back(std::chrono::duration<double>(now - t).count());
+  }
+  inFrame.clear();
+}
+
+// Print the 50th, 90th and 99th percentiles and the maximum of the values, in milliseconds.
+static void printPercentiles(const char* label, std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  auto percentile = [&](double p) {
+    size_t i = static_cast<size_t>(std::ceil(p * values.size())) - 1;
+    return values[std::min(i, values.size() - 1)] * 1e3;
+  };
+  std::cout << "  " << label << ": median " << percentile(0.5) << " ms, 90% " << percentile(0.9)
+    << " ms, 99% " << percentile(0.99) << " ms, max " << values.back() * 1e3 << " ms" << std::endl;
+}
+
+void LatencyProbe::report() const {
+  for (const std::string& m : modeOrder) {
+    const Latencies& l = latencies.at(m);
+    std::cout << "Input latency with " << m << " pacing: " << l.toSwap.size() << " events" << std::endl;
+    if (!l.toSwap.empty()) {
+      printPercentiles("Event to swap returned", l.toSwap);
+      printPercentiles("Event to frame complete", l.toComplete);
+    }
+  }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+//================================================================================================
+// Input-to-present latency probe.  Key and mouse button presses are timestamped when GLFW delivers
+// them, which is during glfwPollEvents() at the end of a frame.  The next frame shows that it saw them
+// by flipping a marker square in the top right corner between black and white, for a photodiode or
+// high-speed camera, and the times at which its swap returns and at which the glFinish() after the
+// swap completes are recorded against each event.  The latencies are kept per pacing mode, the name
+// of which the caller sets whenever it changes how frames are paced.
+//
+// The times measured here end when the frame has been handed to the display, not when it is lit, so
+// they are a lower bound; the marker gives the rest when filmed.
+
+class LatencyProbe {
+public:
+  // Installs key and mouse button callbacks on the window, which call any that were installed before,
+  // and uses its user pointer.  width and height are the window's size.
+  LatencyProbe(GLFWwindow* window, int width, int height, const std::string& mode);
+  ~LatencyProbe();
+
+  // Call when the window's size changes.
+  void setSize(int width, int height);
+
+  // Name of the pacing mode that the following frames are rendered with.
+  void setMode(const std::string& mode);
+
+  // Draw the marker into the current draw framebuffer, flipping it if there have been events since
+  // the previous frame.  Call after the scene, before swapping.
+  void drawMarker();
+
+  // Call right after the swap returns and after the frame is complete, respectively.
+  void swapped();
+  void completed();
+
+  // Print the latency percentiles for each pacing mode.
+  void report() const;
+
+private:
+  LatencyProbe(const LatencyProbe&) = delete;
+  LatencyProbe& operator=(const LatencyProbe&) = delete;
+
+  static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
+  static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+  void event();
+
+  struct Latencies {
+    std::vector<double> toSwap;       // Seconds from the event until the swap returned
+    std::vector<double> toComplete;   // Seconds from the event until the frame was complete
+  };
+
+  GLFWwindow* window;
+  int width;
+  int height;
+  int markerSize;
+  GLFWkeyfun previousKeyCallback = nullptr;
+  GLFWmousebuttonfun previousMouseButtonCallback = nullptr;
+
+  std::string mode;
+  std::map<std::string, Latencies> latencies;
+  std::vector<std::string> modeOrder;       // In the order first used, for the report
+
+  std::vector<std::chrono::steady_clock::time_point> pending;   // Events not yet drawn
+  std::vector<std::chrono::steady_clock::time_point> inFrame;   // Events the current frame shows
+  std::chrono::steady_clock::time_point swapTime;
+  bool marker = false;
+};
@@ -0,0 +1,69 @@
+#include "MappedFile.h"
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& fileName, bool sequential) {
+#ifdef _WIN32
+  file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+    sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    throw std::runtime_error("Could not open " + fileName);
+  }
+  LARGE_INTEGER fileSize;
+  GetFileSizeEx(file, &fileSize);
+  size = static_cast<size_t>(fileSize.QuadPart);
+  if (size > 0) {
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+    if (!data) {
+      release();
+      throw std::runtime_error("Could not map " + fileName);
+    }
+  }
+#else
+  fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Could not open " + fileName);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    release();
+    throw std::runtime_error("Could not get the size of " + fileName);
+  }
+  size = static_cast<size_t>(st.st_size);
+  if (size > 0) {
+    void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      release();
+      throw std::runtime_error("Could not map " + fileName);
+    }
+    madvise(p, size, sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+    data = static_cast<const uint8_t*>(p);
+  }
+#endif
+}
+
+MappedFile::~MappedFile() {
+  release();
+}
+
+void MappedFile::release() {
+#ifdef _WIN32
+  if (data) { UnmapViewOfFile(data); }
+  if (mapping) { CloseHandle(mapping); }
+  if (file != INVALID_HANDLE_VALUE) { CloseHandle(file); }
+  mapping = nullptr;
+  file = INVALID_HANDLE_VALUE;
+#else
+  if (data) { munmap(const_cast<uint8_t*>(data), size); }
+  if (fd >= 0) { close(fd); }
+  fd = -1;
+#endif
+  data = nullptr;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//================================================================================================
+// Read-only memory mapping of a whole file.  Throws std::runtime_error if the file cannot be opened
+// or mapped.  If sequential is true, the OS is told the file will be read front to back; otherwise it
+// is asked to start reading the whole file in right away.
+
+class MappedFile {
+public:
+  explicit MappedFile(const std::string& fileName, bool sequential = false);
+  ~MappedFile();
+
+  const uint8_t* getData() const { return data; }
+  size_t getSize() const { return size; }
+
+private:
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  void release();
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int fd = -1;
+#endif
+  const uint8_t* data = nullptr;
+  size_t size = 0;
+};
@@ -0,0 +1,159 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Bump the version whenever the meaning of an existing section changes.
+static const char Magic[8] = { 'R', '8', 'K', 'M', 'E', 'S', 'H', '\0' };
+static const uint32_t Version = 6;
+static const uint64_t SectionAlignment = 64;
+
+namespace {
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t numSections;
+    float scale;
+    uint32_t seed;
+    uint64_t numTriangles;
+    float color[3];
+    uint32_t geometry;
+    uint32_t packedPositions;
+    uint32_t reserved;
+  };
+
+  struct SectionHeader {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  bool headerMatches(const FileHeader& h, const MeshKey& key) {
+    return std::memcmp(h.magic, Magic, sizeof(Magic)) == 0 && h.version == Version &&
+      h.scale == key.scale && h.seed == key.seed && h.geometry == key.geometry && h.packedPositions == key.packedPositions && h.numTriangles == key.numTriangles &&
+      h.color[0] == key.color[0] && h.color[1] == key.color[1] && h.color[2] == key.color[2];
+  }
+}
+
+std::string MeshCacheEntry::fileName(const std::string& directory, const MeshKey& key) {
+  // FNV-1a over the key fields.
+  uint64_t hash = 14695981039346656037ull;
+  auto add = [&hash](const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+  };
+  add(&key.scale, sizeof(key.scale));
+  add(&key.numTriangles, sizeof(key.numTriangles));
+  add(key.color.data(), sizeof(float) * 3);
+  add(&key.seed, sizeof(key.seed));
+  add(&key.geometry, sizeof(key.geometry));
+  add(&key.packedPositions, sizeof(key.packedPositions));
+  add(&Version, sizeof(Version));
+
+  char name[64];
+  snprintf(name, sizeof(name), "mesh_%016llx.bin", static_cast<unsigned long long>(hash));
+  return directory + "/" + name;
+}
+
+std::shared_ptr<MeshCacheEntry> MeshCacheEntry::open(const std::string& directory, const MeshKey& key) {
+  std::shared_ptr<MeshCacheEntry> entry;
+  try {
+    entry.reset(new MeshCacheEntry(fileName(directory, key)));
+  } catch (std::exception&) {
+    return nullptr;
+  }
+
+  // Validate the header and section table against the file size.
+  const uint8_t* data = entry->file.getData();
+  size_t size = entry->file.getSize();
+  if (size < sizeof(FileHeader)) { return nullptr; }
+  FileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (!headerMatches(header, key)) { return nullptr; }
+  if (size < sizeof(FileHeader) + header.numSections * sizeof(SectionHeader)) { return nullptr; }
+  for (uint32_t i = 0; i < header.numSections; i++) {
+    SectionHeader sh;
+    std::memcpy(&sh, data + sizeof(FileHeader) + i * sizeof(SectionHeader), sizeof(sh));
+    if (sh.offset > size || sh.size > size - sh.offset) { return nullptr; }
+    MeshSection section;
+    section.id = sh.id;
+    section.data = data + sh.offset;
+    section.size = static_cast<size_t>(sh.size);
+    entry->sections.push_back(section);
+  }
+  return entry;
+}
+
+bool MeshCacheEntry::write(const std::string& directory, const MeshKey& key, const std::vector<MeshSection>& sections) {
+  FileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, Magic, sizeof(Magic));
+  header.version = Version;
+  header.numSections = static_cast<uint32_t>(sections.size());
+  header.scale = key.scale;
+  header.seed = key.seed;
+  header.numTriangles = key.numTriangles;
+  header.geometry = key.geometry;
+  header.packedPositions = key.packedPositions;
+  std::copy(key.color.begin(), key.color.end(), header.color);
+
+  // Lay the sections out after the table, each aligned.
+  std::vector<SectionHeader> table(sections.size());
+  uint64_t offset = sizeof(FileHeader) + sections.size() * sizeof(SectionHeader);
+  for (size_t i = 0; i < sections.size(); i++) {
+    offset = (offset + SectionAlignment - 1) / SectionAlignment * SectionAlignment;
+    table[i].id = sections[i].id;
+    table[i].reserved = 0;
+    table[i].offset = offset;
+    table[i].size = sections[i].size;
+    offset += sections[i].size;
+  }
+
+  // Write to a temporary file and rename it, so readers never see a partial entry.
+  std::string name = fileName(directory, key);
+  std::string tempName = name + ".tmp";
+  {
+    std::ofstream out(tempName, std::ios::binary);
+    if (!out) {
+      std::cerr << "Could not write mesh cache file " << tempName << std::endl;
+      return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(SectionHeader));
+    uint64_t position = sizeof(FileHeader) + sections.size() * sizeof(SectionHeader);
+    static const char padding[SectionAlignment] = {};
+    for (size_t i = 0; i < sections.size(); i++) {
+      out.write(padding, static_cast<std::streamsize>(table[i].offset - position));
+      out.write(static_cast<const char*>(sections[i].data), sections[i].size);
+      position = table[i].offset + sections[i].size;
+    }
+    if (!out) {
+      std::cerr << "Failed writing mesh cache file " << tempName << std::endl;
+      std::remove(tempName.c_str());
+      return false;
+    }
+  }
+  std::remove(name.c_str());
+  if (std::rename(tempName.c_str(), name.c_str()) != 0) {
+    std::cerr << "Could not rename " << tempName << " to " << name << std::endl;
+    std::remove(tempName.c_str());
+    return false;
+  }
+  return true;
+}
+
+const void* MeshCacheEntry::getSection(uint32_t id, size_t& size) const {
+  for (const MeshSection& s : sections) {
+    if (s.id == id) {
+      size = s.size;
+      return s.data;
+    }
+  }
+  size = 0;
+  return nullptr;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+//================================================================================================
+// On-disk cache of generated meshes, so that large tessellations are only generated once.  Each entry
+// is a small binary file, named by a hash of the parameters that determine the mesh, holding a header
+// with those parameters and a table of sections (vertex positions, colors, ...).  Entries are
+// memory-mapped when read so that the arrays can be uploaded to OpenGL straight from the mapping.
+// The files use the machine's native byte order and are not meant to be moved between machines.
+
+// Parameters that fully determine a generated mesh.
+struct MeshKey {
+  float scale;
+  uint64_t numTriangles;
+  std::array<float, 3> color;
+  uint32_t seed;
+  uint32_t geometry;    // Layout of the arrays: 0 for a triangle list, 1 for an indexed grid, 2 for strips.
+  uint32_t packedPositions;   // Positions are packed 2_10_10_10 integers instead of three floats.
+};
+
+// Identifiers of the arrays stored in an entry.
+enum MeshSectionId : uint32_t {
+  MeshSectionPositions = 1,
+  MeshSectionColors = 2,
+  MeshSectionIndices = 3,
+  MeshSectionLevels = 4
+};
+
+struct MeshSection {
+  uint32_t id;
+  const void* data;
+  size_t size;
+};
+
+class MeshCacheEntry {
+public:
+  // Map the entry for the key from the directory.  Returns nullptr if there is no valid entry.
+  static std::shared_ptr<MeshCacheEntry> open(const std::string& directory, const MeshKey& key);
+
+  // Write an entry for the key.  Returns false and prints a message if it could not be written.
+  static bool write(const std::string& directory, const MeshKey& key, const std::vector<MeshSection>& sections);
+
+  // Find a section, returning nullptr if the entry does not have it.
+  const void* getSection(uint32_t id, size_t& size) const;
+
+private:
+  explicit MeshCacheEntry(const std::string& fileName) : file(fileName) {}
+  static std::string fileName(const std::string& directory, const MeshKey& key);
+
+  MappedFile file;
+  std::vector<MeshSection> sections;
+};
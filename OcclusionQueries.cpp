@@ -0,0 +1,143 @@
+#include "OcclusionQueries.h"
+#include "ShaderUtils.h"
+#include <iostream>
+
+const float OcclusionQueries::BoxThickness = 0.01f;
+
+// The boxes only need positions; their fragments are counted, not colored.
+static const GLchar* BoxVertexShader =
+R"(#version 330 core
+   layout(location = 0) in vec3 position;
+   uniform mat4 modelViewProjection;
+   void main()
+   {
+      gl_Position = modelViewProjection * vec4(position,1);
+   })";
+
+static const GLchar* BoxFragmentShader =
+R"(#version 330 core
+   void main()
+   {
+   })";
+
+OcclusionQueries::OcclusionQueries(size_t numPlanes)
+  : numPlanes(numPlanes) {
+  program = buildProgram(BoxVertexShader, BoxFragmentShader, "Box");
+  modelViewProjectionUniform = glGetUniformLocation(program, "modelViewProjection");
+
+  // Two triangles for each face of the cube from -1 to 1, which the matrices scale to each box.
+  static const int faces[6][4] = {
+    { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 }, { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 } };
+  std::vector<GLfloat> vertices;
+  for (const auto& face : faces) {
+    for (int corner : { face[0], face[1], face[2], face[0], face[2], face[3] }) {
+      vertices.push_back((corner & 1) ? 1.0f : -1.0f);
+      vertices.push_back((corner & 2) ? 1.0f : -1.0f);
+      vertices.push_back((corner & 4) ? 1.0f : -1.0f);
+    }
+  }
+  numBoxVertices = static_cast<GLsizei>(vertices.size() / 3);
+  glGenBuffers(1, &boxBuffer);
+  glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  for (std::vector<GLuint>& set : queries) {
+    set.resize(numPlanes);
+    glGenQueries(static_cast<GLsizei>(numPlanes), set.data());
+  }
+}
+
+OcclusionQueries::~OcclusionQueries() {
+  for (std::vector<GLuint>& set : queries) {
+    glDeleteQueries(static_cast<GLsizei>(set.size()), set.data());
+  }
+  glDeleteBuffers(1, &boxBuffer);
+  glDeleteProgram(program);
+}
+
+void OcclusionQueries::beginConditionalDraw(size_t plane) {
+  if (framesIssued > 0) {
+    glBeginConditionalRender(queries[current ^ 1][plane], GL_QUERY_NO_WAIT);
+  }
+}
+
+void OcclusionQueries::endConditionalDraw() {
+  if (framesIssued > 0) {
+    glEndConditionalRender();
+  }
+}
+
+void OcclusionQueries::issueQueries(const std::vector< std::array<float, 16> >& modelViewProjections, float extent,
+  GLenum depthFunction) {
+  // This set was last drawn against two frames ago.
+  if (framesIssued >= 2) {
+    collect(queries[current]);
+  }
+
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  glUseProgram(program);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glDepthFunc(depthFunction);
+  glBindVertexArray(0);
+  glEnableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+  glBindBuffer(GL_ARRAY_BUFFER, boxBuffer);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+
+  // Each box is the plane's square, pushed out on both sides so that one face is in front of it.
+  float thickness = extent * BoxThickness;
+  for (size_t p = 0; p < numPlanes && p < modelViewProjections.size(); p++) {
+    const float* m = modelViewProjections[p].data();
+    std::array<float, 16> box;
+    for (int r = 0; r < 4; r++) {
+      box[r] = m[r] * extent;
+      box[4 + r] = m[4 + r] * extent;
+      box[8 + r] = m[8 + r] * thickness;
+      box[12 + r] = m[12 + r];
+    }
+    glUniformMatrix4fv(modelViewProjectionUniform, 1, GL_FALSE, box.data());
+    glBeginQuery(GL_ANY_SAMPLES_PASSED, queries[current][p]);
+    glDrawArrays(GL_TRIANGLES, 0, numBoxVertices);
+    glEndQuery(GL_ANY_SAMPLES_PASSED);
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+  glUseProgram(previousProgram);
+
+  current ^= 1;
+  framesIssued++;
+}
+
+void OcclusionQueries::collect(std::vector<GLuint>& set) {
+  size_t tested = 0;
+  for (GLuint query : set) {
+    GLuint available = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      continue;
+    }
+    GLuint visible = 0;
+    glGetQueryObjectuiv(query, GL_QUERY_RESULT, &visible);
+    if (!visible) {
+      planesHidden++;
+    }
+    tested++;
+  }
+  if (tested) {
+    planesTested += tested;
+    framesCounted++;
+  }
+}
+
+void OcclusionQueries::report() const {
+  std::cout << "Occlusion queries: " << framesIssued << " frames of " << numPlanes << " planes" << std::endl;
+  if (planesTested) {
+    std::cout << "  Hidden planes in " << framesCounted << " frames counted: " << planesHidden << " of "
+      << planesTested << " tested (" << static_cast<double>(planesHidden) / framesCounted << " per frame)" << std::endl;
+  }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// Occlusion culling of separately drawn planes with hardware occlusion queries and conditional
+// rendering.  After each frame's planes are drawn, a thin box around each plane is drawn inside a
+// GL_ANY_SAMPLES_PASSED query with color and depth writes off.  In the next frame each plane is drawn
+// inside glBeginConditionalRender on its query, so the GPU skips planes whose box was completely hidden
+// without the CPU ever waiting for a result.  With GL_QUERY_NO_WAIT, a plane whose query is not finished
+// yet is drawn.
+//
+// Hidden planes are skipped only for the frame after their box test, and a skipped plane is not in that
+// frame's depth buffer, so a plane that becomes uncovered appears a frame late and planes behind a
+// skipped one are drawn at least every other frame.
+//
+// Query results are also read back when their queries are about to be reused, which is two frames
+// later, for the statistics only.
+
+class OcclusionQueries {
+public:
+  // Throws std::runtime_error if the box shaders cannot be built.
+  explicit OcclusionQueries(size_t numPlanes);
+  ~OcclusionQueries();
+
+  // Bracket the draw of one plane, which is skipped if its box was hidden in the previous frame.
+  void beginConditionalDraw(size_t plane);
+  void endConditionalDraw();
+
+  // Test the box of each plane, given its model-view-projection matrix, against the depth buffer of the
+  // current draw framebuffer.  The boxes span the plane's square of half-width extent in x and y, and
+  // BoxThickness times that in z.  depthFunction is the scene's depth comparison.
+  void issueQueries(const std::vector< std::array<float, 16> >& modelViewProjections, float extent,
+    GLenum depthFunction);
+
+  // Print a summary of the planes found to be hidden.
+  void report() const;
+
+  // Half the thickness of the boxes relative to their half-width, so that their front face is nearer
+  // than the plane by a margin that depth precision resolves.
+  static const float BoxThickness;
+
+private:
+  OcclusionQueries(const OcclusionQueries&) = delete;
+  OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+  // Read any results of the query set before it is reused.
+  void collect(std::vector<GLuint>& queries);
+
+  size_t numPlanes;
+  GLuint program = 0;
+  GLint modelViewProjectionUniform = -1;
+  GLuint boxBuffer = 0;
+  GLsizei numBoxVertices = 0;
+
+  // Two sets of queries: the one the current frame draws conditionally on, and the one it issues.
+  std::vector<GLuint> queries[2];
+  size_t current = 0;
+  size_t framesIssued = 0;
+
+  size_t framesCounted = 0;
+  size_t planesTested = 0;
+  uint64_t planesHidden = 0;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+//================================================================================================
+// Minimal work distribution for the CPU-side tools.  Work is split into indexed items (tiles, row
+// bands, frames) that threads pull from a shared counter, so uneven items still balance.
+
+// Number of worker threads to use when the caller does not specify one.
+inline unsigned defaultThreadCount() {
+  unsigned n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+// Call fn(item, threadIndex) for every item in [0, count) using up to numThreads threads.  The calling
+// thread takes part in the work, and all items are complete when this returns.
+inline void parallelFor(size_t count, unsigned numThreads,
+  const std::function<void(size_t item, unsigned threadIndex)>& fn) {
+  if (numThreads < 1) { numThreads = 1; }
+  if (numThreads > count) { numThreads = static_cast<unsigned>(count); }
+  std::atomic<size_t> next(0);
+  auto worker = [&](unsigned threadIndex) {
+    size_t item;
+    while ((item = next.fetch_add(1)) < count) {
+      fn(item, threadIndex);
+    }
+  };
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < numThreads; t++) {
+    threads.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto& t : threads) {
+    t.join();
+  }
+}
@@ -0,0 +1,201 @@
+#include "RowChecksums.h"
+#include "ShaderUtils.h"
+#include <algorithm>
+#include <iostream>
+
+// Number of frames that may be in flight before process() has to wait for the oldest.
+static const size_t NumSlots = 4;
+
+// Threads per row; each hashes a strided subset of the row and the partial hashes are then combined
+// in a fixed order so the result is deterministic.
+static const GLchar* RowHashShader =
+R"(#version 430 core
+   layout(local_size_x = 256) in;
+   layout(binding = 0) uniform sampler2D frame;
+   layout(std430, binding = 0) writeonly buffer RowHashes { uint rowHash[]; };
+   shared uint partial[256];
+   void main()
+   {
+      uint lid = gl_LocalInvocationID.x;
+      ivec2 size = textureSize(frame, 0);
+      int row = int(gl_WorkGroupID.x);
+
+      // FNV-1a over this thread's pixels.
+      uint h = 2166136261u ^ lid;
+      for (int x = int(lid); x < size.x; x += 256) {
+         uvec4 c = uvec4(texelFetch(frame, ivec2(x, row), 0) * 255.0 + 0.5);
+         h = (h ^ (c.r | (c.g << 8) | (c.b << 16))) * 16777619u;
+      }
+      partial[lid] = h;
+      barrier();
+
+      // Order-dependent tree reduction.
+      for (uint s = 128u; s > 0u; s >>= 1) {
+         if (lid < s) {
+            uint a = partial[lid];
+            partial[lid] = a ^ (partial[lid + s] + 0x9e3779b9u + (a << 6) + (a >> 2));
+         }
+         barrier();
+      }
+
+      // Store with the top row first.
+      if (lid == 0u) {
+         rowHash[size.y - 1 - row] = partial[0];
+      }
+   })";
+
+RowChecksums::RowChecksums(int width, int height)
+  : width(width), height(height), slots(NumSlots) {
+  program = linkProgram({ compileShader(GL_COMPUTE_SHADER, RowHashShader, "Row hash shader compilation failed.") },
+    "Row hash program link failed.");
+
+  glGenFramebuffers(1, &framebuffer);
+  for (Slot& slot : slots) {
+    glGenBuffers(1, &slot.buffer);
+  }
+  allocate();
+}
+
+void RowChecksums::allocate() {
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // The hash buffers are only written by the GPU and read by the CPU.
+  for (Slot& slot : slots) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(uint32_t) * height, nullptr, GL_STREAM_READ);
+  }
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void RowChecksums::resize(int width, int height) {
+  if (width == this->width && height == this->height) {
+    return;
+  }
+  // Frames already in flight are checked at the old size; the first one at the new size has nothing
+  // to be compared with.
+  collect(true);
+  this->width = width;
+  this->height = height;
+  glDeleteTextures(1, &texture);
+  allocate();
+  previousHashes.clear();
+}
+
+RowChecksums::~RowChecksums() {
+  for (Slot& slot : slots) {
+    if (slot.fence) { glDeleteSync(slot.fence); }
+    glDeleteBuffers(1, &slot.buffer);
+  }
+  glDeleteFramebuffers(1, &framebuffer);
+  glDeleteTextures(1, &texture);
+  glDeleteProgram(program);
+}
+
+void RowChecksums::process(size_t frameNumber) {
+  // If every slot is still in flight, we have to wait for the oldest one.
+  if (pending.size() == slots.size()) {
+    stalls++;
+    Slot& oldest = slots[pending.front()];
+    glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    collect();
+  }
+
+  // Copy the rendered frame into our texture; this stays on the GPU.
+  GLint drawFramebuffer = 0;
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+  glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+  glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  // Hash every row into this slot's buffer.
+  Slot& slot = slots[nextSlot];
+  GLint previousProgram = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+  glUseProgram(program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, slot.buffer);
+  glDispatchCompute(static_cast<GLuint>(height), 1, 1);
+  glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glUseProgram(previousProgram);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.frameNumber = frameNumber;
+  pending.push_back(nextSlot);
+  nextSlot = (nextSlot + 1) % slots.size();
+}
+
+void RowChecksums::collect(bool wait) {
+  while (!pending.empty()) {
+    Slot& slot = slots[pending.front()];
+    GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    consume(slot);
+    pending.pop_front();
+  }
+}
+
+void RowChecksums::consume(Slot& slot) {
+  glDeleteSync(slot.fence);
+  slot.fence = 0;
+
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+  const void* data = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t) * height, GL_MAP_READ_BIT);
+  if (data) {
+    const uint32_t* rows = static_cast<const uint32_t*>(data);
+    hashes.assign(rows, rows + height);
+  }
+  glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+  glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+  if (!data) {
+    return;
+  }
+
+  // Find the span of rows that changed since the previous frame.
+  if (!previousHashes.empty()) {
+    int top = -1;
+    int bottom = -1;
+    for (int y = 0; y < height; y++) {
+      if (hashes[y] != previousHashes[y]) {
+        if (top < 0) { top = y; }
+        bottom = y;
+      }
+    }
+    if (top >= 0) {
+      inconsistentFrames++;
+      if (top > 0 || bottom < height - 1) {
+        partialFrames++;
+      }
+      lastChangedFrame = slot.frameNumber;
+      lastChangedTop = top;
+      lastChangedBottom = bottom;
+    }
+  }
+  framesChecked++;
+  previousHashes.swap(hashes);
+}
+
+void RowChecksums::report() const {
+  std::cout << "Row checksums: " << framesChecked << " frames checked, "
+    << inconsistentFrames << " differed from the previous frame, "
+    << partialFrames << " only in part of the frame" << std::endl;
+  if (lastChangedTop >= 0) {
+    std::cout << "  Last change in frame " << lastChangedFrame << ", rows " << lastChangedTop << " to " << lastChangedBottom << std::endl;
+  }
+  std::cout << "  Readback per frame: " << sizeof(uint32_t) * height << " bytes, "
+    << stalls << " frames waited for a free slot" << std::endl;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// GPU-side per-row frame checksums.  After a frame is rendered, it is copied into a texture and a
+// compute shader (OpenGL 4.3) reduces each row to a 32-bit hash in a shader storage buffer.  Those
+// buffers are read back asynchronously through a small ring guarded by fences, so checking the frame
+// for consistency costs 4 bytes per row of readback instead of the whole frame.
+//
+// Each frame's hashes are compared with the previous frame's.  When the scene is static (--fixedTime)
+// every frame should match; a frame whose rows differ is reported as inconsistent, and one where only
+// some rows differ is counted as partial, which is what a frame assembled from two renderings (a tear)
+// looks like.
+
+class RowChecksums {
+public:
+  // Throws std::runtime_error if the compute shader cannot be built.
+  RowChecksums(int width, int height);
+  ~RowChecksums();
+
+  // Hash the frame in the currently bound draw framebuffer (before it is swapped), tagged with the
+  // specified frame number.  Leaves the default framebuffer bound.
+  void process(size_t frameNumber);
+
+  // Consume any results whose fences have signaled, without waiting.  If wait is true, block until
+  // all outstanding results are complete.
+  void collect(bool wait = false);
+
+  // Change the size of the frames hashed, after waiting for those in flight.  The next frame is not
+  // compared with the previous one.
+  void resize(int width, int height);
+
+  // Print a summary of the frames checked.
+  void report() const;
+
+  size_t getFramesChecked() const { return framesChecked; }
+  size_t getInconsistentFrames() const { return inconsistentFrames; }
+  size_t getPartialFrames() const { return partialFrames; }
+
+private:
+  RowChecksums(const RowChecksums&) = delete;
+  RowChecksums& operator=(const RowChecksums&) = delete;
+
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = 0;
+    size_t frameNumber = 0;
+  };
+  void consume(Slot& slot);
+  void allocate();
+
+  int width;
+  int height;
+  GLuint program = 0;
+  GLuint texture = 0;
+  GLuint framebuffer = 0;
+  std::vector<Slot> slots;
+  std::deque<size_t> pending;   // Indices of in-flight slots, oldest first
+  size_t nextSlot = 0;
+
+  std::vector<uint32_t> previousHashes;
+  std::vector<uint32_t> hashes;
+  size_t framesChecked = 0;
+  size_t inconsistentFrames = 0;
+  size_t partialFrames = 0;
+  size_t stalls = 0;
+  size_t lastChangedFrame = 0;
+  int lastChangedTop = -1;
+  int lastChangedBottom = -1;
+};
@@ -0,0 +1,150 @@
+#include "Scheduling.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+// Frames longer than this many refresh periods missed at least one vblank.
+static const double LateFrameThreshold = 1.5;
+
+#ifndef _WIN32
+static std::runtime_error systemError(const std::string& what, int error) {
+  return std::runtime_error(what + ": " + std::strerror(error));
+}
+#endif
+
+void pinThreadToCore(int core) {
+#ifdef _WIN32
+  if (core < 0 || core >= 64 || !SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << core)) {
+    throw std::runtime_error("Could not pin the render thread to core " + std::to_string(core));
+  }
+#elif defined(__linux__)
+  if (core < 0 || core >= CPU_SETSIZE) {
+    throw std::runtime_error("Invalid core " + std::to_string(core));
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+  if (result != 0) {
+    throw systemError("Could not pin the render thread to core " + std::to_string(core), result);
+  }
+#else
+  (void)core;
+  throw std::runtime_error("Pinning threads to cores is not supported on this platform");
+#endif
+}
+
+void setRealTimePriority(SchedulingPolicy policy, int priority) {
+#ifdef _WIN32
+  (void)policy;
+  (void)priority;
+  if (!SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+    throw std::runtime_error("Could not raise the render thread's priority");
+  }
+#else
+  int osPolicy = policy == SchedulingPolicy::Fifo ? SCHED_FIFO : SCHED_RR;
+  sched_param param;
+  param.sched_priority = std::max(sched_get_priority_min(osPolicy), std::min(priority, sched_get_priority_max(osPolicy)));
+  int result = pthread_setschedparam(pthread_self(), osPolicy, &param);
+  if (result != 0) {
+    throw systemError(std::string("Could not set ") + (policy == SchedulingPolicy::Fifo ? "SCHED_FIFO" : "SCHED_RR") +
+      " priority " + std::to_string(param.sched_priority), result);
+  }
+#endif
+}
+
+void lockAllMemory() {
+#ifdef _WIN32
+  throw std::runtime_error("Locking all memory is not supported on Windows");
+#else
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+    throw systemError("Could not lock the process's memory", errno);
+  }
+#endif
+}
+
+//================================================================================================
+
+// Context switches of the calling thread so far.
+static void readContextSwitches(uint64_t& involuntary, uint64_t& voluntary) {
+#ifdef _WIN32
+  involuntary = voluntary = 0;
+#else
+  rusage usage;
+#ifdef RUSAGE_THREAD
+  getrusage(RUSAGE_THREAD, &usage);
+#else
+  getrusage(RUSAGE_SELF, &usage);
+#endif
+  involuntary = static_cast<uint64_t>(usage.ru_nivcsw);
+  voluntary = static_cast<uint64_t>(usage.ru_nvcsw);
+#endif
+}
+
+bool ContextSwitchStats::isSupported() {
+#ifdef _WIN32
+  return false;
+#else
+  return true;
+#endif
+}
+
+ContextSwitchStats::ContextSwitchStats(double refreshRate, const std::string& logFile)
+  : refreshPeriod(1.0 / refreshRate) {
+  if (!logFile.empty()) {
+    log.open(logFile);
+    if (!log) {
+      throw std::runtime_error("Could not write " + logFile);
+    }
+    log << "frame,interval_ms,involuntary_switches,voluntary_switches" << std::endl;
+  }
+}
+
+void ContextSwitchStats::sample(size_t frameNumber) {
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  uint64_t involuntary, voluntary;
+  readContextSwitches(involuntary, voluntary);
+  if (started) {
+    double interval = std::chrono::duration<double>(now - lastTime).count();
+    uint64_t frameInvoluntary = involuntary - lastInvoluntary;
+    uint64_t frameVoluntary = voluntary - lastVoluntary;
+    frames++;
+    involuntaryTotal += frameInvoluntary;
+    voluntaryTotal += frameVoluntary;
+    involuntaryMax = std::max(involuntaryMax, frameInvoluntary);
+    if (frameInvoluntary > 0) { preemptedFrames++; }
+    if (interval > LateFrameThreshold * refreshPeriod) {
+      lateFrames++;
+      if (frameInvoluntary > 0) { latePreemptedFrames++; }
+    }
+    if (log.is_open()) {
+      log << frameNumber << "," << interval * 1e3 << "," << frameInvoluntary << "," << frameVoluntary << "\n";
+    }
+  }
+  lastTime = now;
+  lastInvoluntary = involuntary;
+  lastVoluntary = voluntary;
+  started = true;
+}
+
+void ContextSwitchStats::report() const {
+  if (!isSupported()) {
+    std::cout << "Context switches: not available on this platform" << std::endl;
+    return;
+  }
+  std::cout << "Context switches: " << involuntaryTotal << " involuntary (at most " << involuntaryMax
+    << " in a frame) and " << voluntaryTotal << " voluntary in " << frames << " frames" << std::endl;
+  std::cout << "  " << preemptedFrames << " frames were preempted; " << latePreemptedFrames << " of the "
+    << lateFrames << " frames longer than " << LateFrameThreshold << " refresh periods were" << std::endl;
+}
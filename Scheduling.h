@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+//================================================================================================
+// Control over how the OS schedules the render thread, to keep it from being preempted on a busy
+// host, and per-frame counts of the involuntary context switches it suffers, to show whether
+// preemption is what makes frames miss their vblank.
+//
+// Settings apply to the calling thread only (mlockall to the whole process) and are inherited by
+// threads it creates afterwards, so they are meant to be applied after the window and GL context
+// exist, when the driver has already started its own threads.  Each throws std::runtime_error with
+// the reason if the OS refuses, which for real-time priority and memory locking is usually missing
+// privileges (CAP_SYS_NICE, CAP_IPC_LOCK or the rtprio and memlock limits).
+
+enum class SchedulingPolicy { Fifo, RoundRobin };
+
+// Run the calling thread only on the specified logical CPU.
+void pinThreadToCore(int core);
+
+// Give the calling thread a real-time policy and static priority (1-99 on Linux).  On Windows the
+// thread gets time-critical priority whatever the policy.
+void setRealTimePriority(SchedulingPolicy policy, int priority);
+
+// Lock all current and future pages of the process into memory so that the render loop never
+// takes a major page fault.  Not supported on Windows.
+void lockAllMemory();
+
+// Per-frame involuntary (and voluntary) context switches of the calling thread, from getrusage, with
+// each frame's interval so that frames that overran the refresh period can be matched with them.
+// Not supported on Windows, where the counts are zero.
+class ContextSwitchStats {
+public:
+  // refreshRate in Hz.  If logFile is not empty, one CSV row per frame is written to it.  Throws
+  // std::runtime_error if the log cannot be written.
+  ContextSwitchStats(double refreshRate, const std::string& logFile);
+
+  // Call once per frame on the render thread, at the same point in each frame.
+  void sample(size_t frameNumber);
+
+  // Call when the display's refresh rate changes, for the frames that follow.
+  void setRefreshRate(double refreshRate) { refreshPeriod = 1.0 / refreshRate; }
+
+  // Print how many frames were preempted and how that lines up with the late frames.
+  void report() const;
+
+  // Whether the counts come from the OS on this platform.
+  static bool isSupported();
+
+private:
+  ContextSwitchStats(const ContextSwitchStats&) = delete;
+  ContextSwitchStats& operator=(const ContextSwitchStats&) = delete;
+
+  double refreshPeriod;
+  std::ofstream log;
+  bool started = false;
+  std::chrono::steady_clock::time_point lastTime;
+  uint64_t lastInvoluntary = 0;
+  uint64_t lastVoluntary = 0;
+
+  size_t frames = 0;
+  size_t preemptedFrames = 0;
+  uint64_t involuntaryTotal = 0;
+  uint64_t voluntaryTotal = 0;
+  uint64_t involuntaryMax = 0;
+  size_t lateFrames = 0;
+  size_t latePreemptedFrames = 0;
+};
@@ -0,0 +1,139 @@
+#include "ShaderReloader.h"
+#include "ShaderUtils.h"
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// How often the watcher checks whether it should quit (and, without inotify, polls the files).
+static const int PollIntervalMs = 200;
+
+// Editors often write a file in several steps, so wait this long after a change before rebuilding.
+static const int SettleTimeMs = 50;
+
+ShaderReloader::ShaderReloader(GLFWwindow* shareWith, const std::string& vertexFile, const std::string& fragmentFile,
+  const std::string& vertexFallback, const std::string& fragmentFallback)
+  : vertexFile(vertexFile), fragmentFile(fragmentFile),
+    vertexFallback(vertexFallback), fragmentFallback(fragmentFallback), quit(false), readyProgram(0) {
+  // Invisible window whose context shares programs with the rendering context.
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  compileWindow = glfwCreateWindow(1, 1, "Shader compiler", nullptr, shareWith);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+  if (!compileWindow) {
+    throw std::runtime_error("Could not create shared context for shader reloading.");
+  }
+
+#ifdef __linux__
+  // Watch the directories rather than the files, so that editors that replace the file by renaming
+  // a new one over it are noticed.
+  inotifyFd = inotify_init1(IN_NONBLOCK);
+  for (const std::string* file : { &this->vertexFile, &this->fragmentFile }) {
+    if (file->empty()) { continue; }
+    size_t slash = file->find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : file->substr(0, slash);
+    inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  }
+#endif
+
+  thread = std::thread(&ShaderReloader::run, this);
+}
+
+ShaderReloader::~ShaderReloader() {
+  quit = true;
+  thread.join();
+#ifdef __linux__
+  close(inotifyFd);
+#endif
+  GLuint unused = readyProgram.exchange(0);
+  if (unused) {
+    glDeleteProgram(unused);
+  }
+  glfwDestroyWindow(compileWindow);
+}
+
+std::string ShaderReloader::loadSource(const std::string& fileName, const std::string& fallback) {
+  return fileName.empty() ? fallback : readShaderFile(fileName);
+}
+
+void ShaderReloader::run() {
+  glfwMakeContextCurrent(compileWindow);
+  while (waitForChange()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(SettleTimeMs));
+    rebuild();
+  }
+  glfwMakeContextCurrent(nullptr);
+}
+
+// Block until one of the files changes (returns true) or we are asked to quit (returns false).
+bool ShaderReloader::waitForChange() {
+#ifdef __linux__
+  auto baseName = [](const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+  };
+  const std::string names[2] = { baseName(vertexFile), baseName(fragmentFile) };
+  alignas(struct inotify_event) char buffer[4096];
+  while (!quit) {
+    struct pollfd pfd = { inotifyFd, POLLIN, 0 };
+    if (poll(&pfd, 1, PollIntervalMs) <= 0) { continue; }
+    bool changed = false;
+    ssize_t n;
+    while ((n = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < buffer + n; ) {
+        const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+        if (event->len > 0) {
+          std::string name(event->name);
+          changed = changed || (!vertexFile.empty() && name == names[0]) || (!fragmentFile.empty() && name == names[1]);
+        }
+        p += sizeof(struct inotify_event) + event->len;
+      }
+    }
+    if (changed) { return true; }
+  }
+  return false;
+#else
+  auto modificationTime = [](const std::string& path) -> long long {
+    struct stat st;
+    return (!path.empty() && stat(path.c_str(), &st) == 0) ? static_cast<long long>(st.st_mtime) : 0;
+  };
+  long long vertexTime = modificationTime(vertexFile);
+  long long fragmentTime = modificationTime(fragmentFile);
+  while (!quit) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(PollIntervalMs));
+    if (modificationTime(vertexFile) != vertexTime || modificationTime(fragmentFile) != fragmentTime) {
+      return true;
+    }
+  }
+  return false;
+#endif
+}
+
+void ShaderReloader::rebuild() {
+  GLuint program = 0;
+  try {
+    std::string vertexSource = loadSource(vertexFile, vertexFallback);
+    std::string fragmentSource = loadSource(fragmentFile, fragmentFallback);
+    program = buildProgram(vertexSource.c_str(), fragmentSource.c_str(), "Plane");
+  } catch (std::exception& e) {
+    std::cerr << "Shader reload failed, keeping the current program: " << e.what() << std::endl;
+    return;
+  }
+
+  // Make sure the program is complete on the GPU before another context uses it.
+  GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+  glDeleteSync(fence);
+
+  // Publish it, discarding any earlier program the render thread has not picked up yet.
+  GLuint previous = readyProgram.exchange(program);
+  if (previous) {
+    glDeleteProgram(previous);
+  }
+  std::cout << "Shaders reloaded" << std::endl;
+}
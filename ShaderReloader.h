@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+//================================================================================================
+// Rebuilds the vertex/fragment program when its source files change on disk, without stalling the
+// render loop.  A background thread watches the files (inotify on Linux, modification times elsewhere)
+// and compiles and links the new program on a hidden window whose context shares objects with the
+// rendering context.  Once the program is built and a fence shows the GPU has it, the program name is
+// published atomically and the render thread swaps to it between frames with takeProgram().
+//
+// A file name may be empty, in which case that stage always uses its fallback source.
+
+class ShaderReloader {
+public:
+  // Must be called from the main thread because it creates the hidden shared window.
+  ShaderReloader(GLFWwindow* shareWith, const std::string& vertexFile, const std::string& fragmentFile,
+    const std::string& vertexFallback, const std::string& fragmentFallback);
+  ~ShaderReloader();
+
+  // Returns a newly built program, which the caller then owns, or 0 if there is none.
+  GLuint takeProgram() { return readyProgram.exchange(0); }
+
+  // Source for a stage: the file's contents, or the fallback source if no file was given.
+  static std::string loadSource(const std::string& fileName, const std::string& fallback);
+
+private:
+  ShaderReloader(const ShaderReloader&) = delete;
+  ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+  void run();
+  bool waitForChange();
+  void rebuild();
+
+  GLFWwindow* compileWindow = nullptr;
+  std::string vertexFile;
+  std::string fragmentFile;
+  std::string vertexFallback;
+  std::string fragmentFallback;
+  std::atomic<bool> quit;
+  std::atomic<GLuint> readyProgram;
+  std::thread thread;
+#ifdef __linux__
+  int inotifyFd = -1;
+#endif
+};
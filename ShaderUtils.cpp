@@ -0,0 +1,85 @@
+#include "ShaderUtils.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+void checkShaderError(GLuint shaderId, const std::string& exceptionMsg) {
+  GLint result = GL_FALSE;
+  int infoLength = 0;
+  glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
+  glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLength);
+  if (result == GL_FALSE) {
+    std::vector<GLchar> errorMessage(infoLength + 1);
+    glGetShaderInfoLog(shaderId, infoLength, NULL, &errorMessage[0]);
+    std::cerr << &errorMessage[0] << std::endl;
+    throw std::runtime_error(exceptionMsg);
+  }
+}
+
+void checkProgramError(GLuint programId, const std::string& exceptionMsg) {
+  GLint result = GL_FALSE;
+  int infoLength = 0;
+  glGetProgramiv(programId, GL_LINK_STATUS, &result);
+  glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLength);
+  if (result == GL_FALSE) {
+    std::vector<GLchar> errorMessage(infoLength + 1);
+    glGetProgramInfoLog(programId, infoLength, NULL, &errorMessage[0]);
+    std::cerr << &errorMessage[0] << std::endl;
+    throw std::runtime_error(exceptionMsg);
+  }
+}
+
+GLuint compileShader(GLenum type, const GLchar* source, const std::string& exceptionMsg) {
+  GLuint shaderId = glCreateShader(type);
+  glShaderSource(shaderId, 1, &source, NULL);
+  glCompileShader(shaderId);
+  try {
+    checkShaderError(shaderId, exceptionMsg);
+  } catch (...) {
+    glDeleteShader(shaderId);
+    throw;
+  }
+  return shaderId;
+}
+
+std::string readShaderFile(const std::string& fileName) {
+  std::ifstream in(fileName, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error("Could not read shader file " + fileName);
+  }
+  std::ostringstream contents;
+  contents << in.rdbuf();
+  return contents.str();
+}
+
+GLuint linkProgram(const std::vector<GLuint>& shaders, const std::string& exceptionMsg) {
+  GLuint programId = glCreateProgram();
+  for (GLuint shader : shaders) {
+    glAttachShader(programId, shader);
+  }
+  glLinkProgram(programId);
+  for (GLuint shader : shaders) {
+    glDetachShader(programId, shader);
+    glDeleteShader(shader);
+  }
+  try {
+    checkProgramError(programId, exceptionMsg);
+  } catch (...) {
+    glDeleteProgram(programId);
+    throw;
+  }
+  return programId;
+}
+
+GLuint buildProgram(const GLchar* vertexSource, const GLchar* fragmentSource, const std::string& name) {
+  GLuint vertexShader = compileShader(GL_VERTEX_SHADER, vertexSource, name + " vertex shader compilation failed.");
+  GLuint fragmentShader = 0;
+  try {
+    fragmentShader = compileShader(GL_FRAGMENT_SHADER, fragmentSource, name + " fragment shader compilation failed.");
+  } catch (...) {
+    glDeleteShader(vertexShader);
+    throw;
+  }
+  return linkProgram({ vertexShader, fragmentShader }, name + " program link failed.");
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+//================================================================================================
+// Functions to check for errors when building shaders and programs, and to build them.  Failures
+// print the info log to std::cerr and throw std::runtime_error with the specified message.
+
+void checkShaderError(GLuint shaderId, const std::string& exceptionMsg);
+void checkProgramError(GLuint programId, const std::string& exceptionMsg);
+
+// Compile a shader of the specified type from source.
+GLuint compileShader(GLenum type, const GLchar* source, const std::string& exceptionMsg);
+
+// Read a shader source file, throwing std::runtime_error if it cannot be read.
+std::string readShaderFile(const std::string& fileName);
+
+// Link the shaders into a new program.  The shaders are deleted whether or not linking succeeds.
+GLuint linkProgram(const std::vector<GLuint>& shaders, const std::string& exceptionMsg);
+
+// Compile a vertex and a fragment shader and link them into a new program, deleting whatever was
+// built if a step fails.  The exception messages start with name, e.g. "HUD vertex shader ...".
+GLuint buildProgram(const GLchar* vertexSource, const GLchar* fragmentSource, const std::string& name);
@@ -0,0 +1,408 @@
+#include "SoftwareRasterizer.h"
+#include "Parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTERIZER_SSE2 1
+#endif
+
+// Screen tiles are square; the width is a multiple of the four-pixel SIMD group.
+static const int TileSize = 64;
+
+// Number of triangles set up by each parallel work item.
+static const size_t TrianglesPerChunk = 1024;
+
+// Clipping happens against the near and far planes and against a guard band twice the size of the
+// viewport, so that edge functions stay within comfortable floating-point range.
+static const float GuardBand = 2.0f;
+
+static uint32_t packColor(float r, float g, float b) {
+  auto toByte = [](float c) {
+    c = std::min(std::max(c, 0.0f), 1.0f);
+    return static_cast<uint32_t>(c * 255.0f + 0.5f);
+  };
+  // Bytes in memory are R, G, B, A on little-endian machines.
+  return toByte(r) | (toByte(g) << 8) | (toByte(b) << 16) | 0xff000000u;
+}
+
+SoftwareRasterizer::SoftwareRasterizer(int width, int height, unsigned numThreads)
+  : width(width), height(height), numThreads(numThreads ? numThreads : defaultThreadCount()),
+    tilesX((width + TileSize - 1) / TileSize), tilesY((height + TileSize - 1) / TileSize),
+    image(width, height), depth(static_cast<size_t>(width) * height),
+    bins(static_cast<size_t>(tilesX) * tilesY) {
+}
+
+void SoftwareRasterizer::clear(const std::array<float, 3>& color) {
+  uint32_t packed = packColor(color[0], color[1], color[2]);
+  float far = reversedZ ? 0.0f : 1.0f;
+  parallelFor(static_cast<size_t>(height), numThreads, [&](size_t y, unsigned) {
+    uint32_t* row = reinterpret_cast<uint32_t*>(image.row(static_cast<int>(y)));
+    std::fill(row, row + width, packed);
+    std::fill(depth.begin() + y * width, depth.begin() + (y + 1) * width, far);
+  });
+}
+
+void SoftwareRasterizer::drawTriangles(const float* positions, const float* colors, size_t numVertices,
+  const float modelViewProjection[16]) {
+  Draw d;
+  d.positions = positions;
+  d.colors = colors;
+  d.palette = nullptr;
+  d.trianglesPerEntry = 1;
+  d.numTriangles = numVertices / 3;
+  std::copy(modelViewProjection, modelViewProjection + 16, d.mvp.begin());
+  draws.push_back(d);
+}
+
+void SoftwareRasterizer::drawFlatTriangles(const float* positions, size_t numVertices, const uint8_t* palette,
+  size_t trianglesPerEntry, const std::array<float, 3>& color, const float modelViewProjection[16]) {
+  Draw d;
+  d.positions = positions;
+  d.colors = nullptr;
+  d.palette = palette;
+  d.trianglesPerEntry = trianglesPerEntry;
+  d.paletteColor = color;
+  d.numTriangles = numVertices / 3;
+  std::copy(modelViewProjection, modelViewProjection + 16, d.mvp.begin());
+  draws.push_back(d);
+}
+
+//================================================================================================
+// Vertex transformation, clipping and triangle setup.
+
+namespace {
+  // Clip-space vertex with its color.
+  struct ClipVertex {
+    float pos[4];
+    float color[3];
+  };
+
+  // Clip a convex polygon against the half-space dot(plane, pos) >= 0 (Sutherland-Hodgman).
+  int clipPolygon(const ClipVertex* in, int numIn, const float plane[4], ClipVertex* out) {
+    int numOut = 0;
+    for (int i = 0; i < numIn; i++) {
+      const ClipVertex& a = in[i];
+      const ClipVertex& b = in[(i + 1) % numIn];
+      float da = plane[0] * a.pos[0] + plane[1] * a.pos[1] + plane[2] * a.pos[2] + plane[3] * a.pos[3];
+      float db = plane[0] * b.pos[0] + plane[1] * b.pos[1] + plane[2] * b.pos[2] + plane[3] * b.pos[3];
+      if (da >= 0) {
+        out[numOut++] = a;
+      }
+      if ((da >= 0) != (db >= 0)) {
+        float t = da / (da - db);
+        ClipVertex& v = out[numOut++];
+        for (int k = 0; k < 4; k++) { v.pos[k] = a.pos[k] + t * (b.pos[k] - a.pos[k]); }
+        for (int k = 0; k < 3; k++) { v.color[k] = a.color[k] + t * (b.color[k] - a.color[k]); }
+      }
+    }
+    return numOut;
+  }
+}
+
+void SoftwareRasterizer::setupChunk(const Chunk& chunk, std::vector<Triangle>& out) const {
+  const Draw& d = draws[chunk.draw];
+  const float* m = d.mvp.data();
+
+  // Near and far planes differ between the [-1,1] and [0,1] depth conventions.
+  const float planes[6][4] = {
+    { 0, 0, reversedZ ? -1.0f : 1.0f, 1 },   // near: z >= -w, or z <= w for reversed-Z
+    { 0, 0, reversedZ ? 1.0f : -1.0f, reversedZ ? 0.0f : 1.0f },   // far: z <= w, or z >= 0
+    { 1, 0, 0, GuardBand },
+    { -1, 0, 0, GuardBand },
+    { 0, 1, 0, GuardBand },
+    { 0, -1, 0, GuardBand }
+  };
+
+  out.clear();
+  for (size_t t = chunk.firstTriangle; t < chunk.firstTriangle + chunk.numTriangles; t++) {
+    // Transform by the column-major model-view-projection matrix.
+    ClipVertex poly[2][12];
+    float flatColor[3];
+    if (d.palette) {
+      float brightness = d.palette[t / d.trianglesPerEntry] / 255.0f;
+      for (int k = 0; k < 3; k++) { flatColor[k] = d.paletteColor[k] * brightness; }
+    }
+    for (int v = 0; v < 3; v++) {
+      const float* p = d.positions + (t * 3 + v) * 3;
+      const float* c = d.palette ? flatColor : d.colors + (t * 3 + v) * 3;
+      ClipVertex& cv = poly[0][v];
+      for (int r = 0; r < 4; r++) {
+        cv.pos[r] = m[r] * p[0] + m[4 + r] * p[1] + m[8 + r] * p[2] + m[12 + r];
+      }
+      std::copy(c, c + 3, cv.color);
+    }
+
+    // Only clip when a vertex is outside a plane; nearly all triangles skip this.
+    int numVerts = 3;
+    int current = 0;
+    for (int p = 0; p < 6 && numVerts >= 3; p++) {
+      bool outside = false;
+      for (int v = 0; v < numVerts; v++) {
+        const float* pos = poly[current][v].pos;
+        if (planes[p][0] * pos[0] + planes[p][1] * pos[1] + planes[p][2] * pos[2] + planes[p][3] * pos[3] < 0) {
+          outside = true;
+          break;
+        }
+      }
+      if (outside) {
+        numVerts = clipPolygon(poly[current], numVerts, planes[p], poly[1 - current]);
+        current = 1 - current;
+      }
+    }
+
+    // Project to the screen and emit a fan of triangles.
+    struct ScreenVertex { double x, y; float depth, invW; const float* color; } sv[12];
+    for (int v = 0; v < numVerts; v++) {
+      const ClipVertex& cv = poly[current][v];
+      float invW = 1.0f / cv.pos[3];
+      float ndcZ = cv.pos[2] * invW;
+      sv[v].x = (cv.pos[0] * invW * 0.5 + 0.5) * width;
+      sv[v].y = (0.5 - cv.pos[1] * invW * 0.5) * height;
+      sv[v].depth = reversedZ ? ndcZ : ndcZ * 0.5f + 0.5f;
+      sv[v].invW = invW;
+      sv[v].color = cv.color;
+    }
+    for (int v = 1; v + 1 < numVerts; v++) {
+      const ScreenVertex* tv[3] = { &sv[0], &sv[v], &sv[v + 1] };
+      Triangle tri;
+      tri.originX = static_cast<float>(tv[0]->x);
+      tri.originY = static_cast<float>(tv[0]->y);
+
+      // Edge k is opposite vertex k, with coordinates relative to the origin.
+      double area = 0;
+      for (int k = 0; k < 3; k++) {
+        const ScreenVertex* a = tv[(k + 1) % 3];
+        const ScreenVertex* b = tv[(k + 2) % 3];
+        double ax = a->x - tri.originX, ay = a->y - tri.originY;
+        double bx = b->x - tri.originX, by = b->y - tri.originY;
+        tri.edgeA[k] = static_cast<float>(ay - by);
+        tri.edgeB[k] = static_cast<float>(bx - ax);
+        tri.edgeC[k] = static_cast<float>(ax * by - ay * bx);
+        if (k == 0) { area = ax * by - ay * bx; }
+      }
+      if (area == 0) { continue; }
+
+      // Face culling is disabled, so flip back-facing triangles to keep the inside positive.
+      if (area < 0) {
+        area = -area;
+        for (int k = 0; k < 3; k++) {
+          tri.edgeA[k] = -tri.edgeA[k];
+          tri.edgeB[k] = -tri.edgeB[k];
+          tri.edgeC[k] = -tri.edgeC[k];
+        }
+      }
+      tri.invArea = static_cast<float>(1.0 / area);
+      for (int k = 0; k < 3; k++) {
+        tri.topLeft[k] = tri.edgeA[k] > 0 || (tri.edgeA[k] == 0 && tri.edgeB[k] > 0);
+        tri.depth[k] = tv[k]->depth;
+        tri.invW[k] = tv[k]->invW;
+        std::copy(tv[k]->color, tv[k]->color + 3, tri.color[k]);
+      }
+      tri.flat = std::equal(tri.color[0], tri.color[0] + 3, tri.color[1]) &&
+                 std::equal(tri.color[0], tri.color[0] + 3, tri.color[2]);
+      tri.packedColor = packColor(tri.color[0][0], tri.color[0][1], tri.color[0][2]);
+
+      // Pixel centers at (x + 0.5, y + 0.5) inside the bounding box.
+      double minX = std::min(tv[0]->x, std::min(tv[1]->x, tv[2]->x));
+      double maxX = std::max(tv[0]->x, std::max(tv[1]->x, tv[2]->x));
+      double minY = std::min(tv[0]->y, std::min(tv[1]->y, tv[2]->y));
+      double maxY = std::max(tv[0]->y, std::max(tv[1]->y, tv[2]->y));
+      tri.minX = std::max(0, static_cast<int>(std::ceil(minX - 0.5)));
+      tri.maxX = std::min(width - 1, static_cast<int>(std::floor(maxX - 0.5)));
+      tri.minY = std::max(0, static_cast<int>(std::ceil(minY - 0.5)));
+      tri.maxY = std::min(height - 1, static_cast<int>(std::floor(maxY - 0.5)));
+      if (tri.minX > tri.maxX || tri.minY > tri.maxY) { continue; }
+
+      out.push_back(tri);
+    }
+  }
+}
+
+//================================================================================================
+// Rasterization of one screen tile.
+
+void SoftwareRasterizer::rasterizeTile(size_t tile) {
+  int tileX0 = static_cast<int>(tile % tilesX) * TileSize;
+  int tileY0 = static_cast<int>(tile / tilesX) * TileSize;
+  int tileX1 = std::min(tileX0 + TileSize, width) - 1;
+  int tileY1 = std::min(tileY0 + TileSize, height) - 1;
+
+  for (const Triangle* tri : bins[tile]) {
+    int x0 = std::max(tri->minX, tileX0);
+    int x1 = std::min(tri->maxX, tileX1);
+    int y0 = std::max(tri->minY, tileY0);
+    int y1 = std::min(tri->maxY, tileY1);
+    if (x0 > x1 || y0 > y1) { continue; }
+
+    // Start four-pixel groups on a multiple of four from the tile origin.
+    x0 = tileX0 + ((x0 - tileX0) & ~3);
+
+    for (int y = y0; y <= y1; y++) {
+      float py = y + 0.5f - tri->originY;
+      uint32_t* colorRow = reinterpret_cast<uint32_t*>(image.row(y));
+      float* depthRow = &depth[static_cast<size_t>(y) * width];
+
+#ifdef RASTERIZER_SSE2
+      const __m128 zero = _mm_setzero_ps();
+      const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+      __m128 rowE[3], stepE[3], topLeft[3];
+      for (int k = 0; k < 3; k++) {
+        rowE[k] = _mm_set1_ps(tri->edgeB[k] * py + tri->edgeC[k]);
+        stepE[k] = _mm_set1_ps(tri->edgeA[k]);
+        topLeft[k] = _mm_castsi128_ps(_mm_set1_epi32(tri->topLeft[k] ? -1 : 0));
+      }
+      const __m128 invArea = _mm_set1_ps(tri->invArea);
+      for (int x = x0; x <= x1; x += 4) {
+        __m128 px = _mm_add_ps(_mm_set1_ps(x - tri->originX), laneOffsets);
+        __m128 e[3];
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 3; k++) {
+          e[k] = _mm_add_ps(_mm_mul_ps(stepE[k], px), rowE[k]);
+          __m128 covered = _mm_or_ps(_mm_cmpgt_ps(e[k], zero), _mm_and_ps(_mm_cmpeq_ps(e[k], zero), topLeft[k]));
+          inside = _mm_and_ps(inside, covered);
+        }
+        // Lanes past the right edge of the framebuffer.
+        if (x + 4 > width) {
+          inside = _mm_and_ps(inside, _mm_castsi128_ps(_mm_cmplt_epi32(
+            _mm_add_epi32(_mm_set1_epi32(x), _mm_set_epi32(3, 2, 1, 0)), _mm_set1_epi32(width))));
+        }
+        if (_mm_movemask_ps(inside) == 0) { continue; }
+
+        // Barycentric weights and depth test.
+        __m128 b0 = _mm_mul_ps(e[0], invArea);
+        __m128 b1 = _mm_mul_ps(e[1], invArea);
+        __m128 b2 = _mm_mul_ps(e[2], invArea);
+        __m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(b0, _mm_set1_ps(tri->depth[0])),
+          _mm_mul_ps(b1, _mm_set1_ps(tri->depth[1]))), _mm_mul_ps(b2, _mm_set1_ps(tri->depth[2])));
+        int lanes = std::min(4, width - x);
+        float oldDepth[4] = { 0, 0, 0, 0 };
+        std::memcpy(oldDepth, depthRow + x, lanes * sizeof(float));
+        __m128 old = _mm_loadu_ps(oldDepth);
+        __m128 pass = reversedZ ? _mm_cmpgt_ps(z, old) : _mm_cmplt_ps(z, old);
+        __m128 write = _mm_and_ps(inside, pass);
+        int writeMask = _mm_movemask_ps(write);
+        if (writeMask == 0) { continue; }
+
+        __m128i color;
+        if (tri->flat) {
+          color = _mm_set1_epi32(static_cast<int>(tri->packedColor));
+        } else {
+          // Perspective-correct color interpolation.
+          __m128 p0 = _mm_mul_ps(b0, _mm_set1_ps(tri->invW[0]));
+          __m128 p1 = _mm_mul_ps(b1, _mm_set1_ps(tri->invW[1]));
+          __m128 p2 = _mm_mul_ps(b2, _mm_set1_ps(tri->invW[2]));
+          __m128 norm = _mm_div_ps(_mm_set1_ps(255.0f), _mm_add_ps(_mm_add_ps(p0, p1), p2));
+          __m128i channels[3];
+          for (int c = 0; c < 3; c++) {
+            __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(p0, _mm_set1_ps(tri->color[0][c])),
+              _mm_mul_ps(p1, _mm_set1_ps(tri->color[1][c]))), _mm_mul_ps(p2, _mm_set1_ps(tri->color[2][c])));
+            v = _mm_add_ps(_mm_mul_ps(v, norm), _mm_set1_ps(0.5f));
+            v = _mm_min_ps(_mm_max_ps(v, zero), _mm_set1_ps(255.0f));
+            channels[c] = _mm_cvttps_epi32(v);
+          }
+          color = _mm_or_si128(_mm_or_si128(channels[0], _mm_slli_epi32(channels[1], 8)),
+            _mm_or_si128(_mm_slli_epi32(channels[2], 16), _mm_set1_epi32(static_cast<int>(0xff000000u))));
+        }
+
+        float newDepth[4];
+        uint32_t newColor[4];
+        _mm_storeu_ps(newDepth, z);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(newColor), color);
+        for (int l = 0; l < lanes; l++) {
+          if (writeMask & (1 << l)) {
+            depthRow[x + l] = newDepth[l];
+            colorRow[x + l] = newColor[l];
+          }
+        }
+      }
+#else
+      for (int x = x0; x <= x1 && x < width; x++) {
+        float px = x + 0.5f - tri->originX;
+        float e[3];
+        bool inside = true;
+        for (int k = 0; k < 3; k++) {
+          e[k] = tri->edgeA[k] * px + tri->edgeB[k] * py + tri->edgeC[k];
+          inside = inside && (e[k] > 0 || (e[k] == 0 && tri->topLeft[k]));
+        }
+        if (!inside) { continue; }
+        float b[3] = { e[0] * tri->invArea, e[1] * tri->invArea, e[2] * tri->invArea };
+        float z = b[0] * tri->depth[0] + b[1] * tri->depth[1] + b[2] * tri->depth[2];
+        if (reversedZ ? !(z > depthRow[x]) : !(z < depthRow[x])) { continue; }
+        depthRow[x] = z;
+        if (tri->flat) {
+          colorRow[x] = tri->packedColor;
+        } else {
+          float p[3] = { b[0] * tri->invW[0], b[1] * tri->invW[1], b[2] * tri->invW[2] };
+          float norm = 1.0f / (p[0] + p[1] + p[2]);
+          float c[3];
+          for (int k = 0; k < 3; k++) {
+            c[k] = (p[0] * tri->color[0][k] + p[1] * tri->color[1][k] + p[2] * tri->color[2][k]) * norm;
+          }
+          colorRow[x] = packColor(c[0], c[1], c[2]);
+        }
+      }
+#endif
+    }
+  }
+}
+
+//================================================================================================
+// Frame rendering.
+
+void SoftwareRasterizer::finish() {
+  // Split every draw into chunks, keeping submission order.
+  std::vector<Chunk> chunks;
+  trianglesSubmitted = 0;
+  for (size_t d = 0; d < draws.size(); d++) {
+    for (size_t first = 0; first < draws[d].numTriangles; first += TrianglesPerChunk) {
+      Chunk c;
+      c.draw = d;
+      c.firstTriangle = first;
+      c.numTriangles = std::min(TrianglesPerChunk, draws[d].numTriangles - first);
+      chunks.push_back(c);
+    }
+    trianglesSubmitted += draws[d].numTriangles;
+  }
+  if (chunkTriangles.size() < chunks.size()) {
+    chunkTriangles.resize(chunks.size());
+  }
+
+  // Phase 1: transform, clip and set up triangles.
+  parallelFor(chunks.size(), numThreads, [&](size_t c, unsigned) {
+    setupChunk(chunks[c], chunkTriangles[c]);
+  });
+
+  // Phase 2: bin triangles into tiles.  Each work item owns a row of tiles and walks the chunks in
+  // order, so every bin lists its triangles in submission order.
+  parallelFor(static_cast<size_t>(tilesY), numThreads, [&](size_t ty, unsigned) {
+    for (int tx = 0; tx < tilesX; tx++) {
+      bins[ty * tilesX + tx].clear();
+    }
+    int rowY0 = static_cast<int>(ty) * TileSize;
+    int rowY1 = rowY0 + TileSize - 1;
+    for (size_t c = 0; c < chunks.size(); c++) {
+      for (const Triangle& tri : chunkTriangles[c]) {
+        if (tri.maxY < rowY0 || tri.minY > rowY1) { continue; }
+        int tx0 = tri.minX / TileSize;
+        int tx1 = tri.maxX / TileSize;
+        for (int tx = tx0; tx <= tx1; tx++) {
+          bins[ty * tilesX + tx].push_back(&tri);
+        }
+      }
+    }
+  });
+
+  // Phase 3: rasterize tiles independently.
+  parallelFor(bins.size(), numThreads, [&](size_t tile, unsigned) {
+    rasterizeTile(tile);
+  });
+
+  trianglesRasterized = 0;
+  for (size_t c = 0; c < chunks.size(); c++) {
+    trianglesRasterized += chunkTriangles[c].size();
+  }
+  draws.clear();
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Image.h"
+
+//================================================================================================
+// Tile-binned, multi-threaded software rasterizer that renders the same non-indexed triangle lists
+// (three floats of position per vertex, with a color per vertex or a palette of brightnesses) that
+// MeshPlane sends to OpenGL.  It gives
+// a reference image of the scene and a CPU throughput baseline on machines without a usable GPU.
+//
+// Draw calls are only recorded by drawTriangles(); all of the work happens in finish(), which runs
+// three parallel phases: vertex transform/clip/setup over chunks of triangles, binning of the set-up
+// triangles into screen tiles (in submission order, so depth ties resolve as they do in OpenGL), and
+// rasterization of each tile using SIMD edge functions with a depth test.
+
+class SoftwareRasterizer {
+public:
+  // numThreads of 0 uses one thread per hardware thread.
+  SoftwareRasterizer(int width, int height, unsigned numThreads = 0);
+
+  // Select the depth convention: standard OpenGL [-1,1] clip depth tested with GL_LESS, or reversed-Z
+  // [0,1] clip depth (glClipControl GL_ZERO_TO_ONE) tested with GL_GREATER.
+  void setReversedZ(bool reversed) { reversedZ = reversed; }
+
+  // Fill the color buffer and reset depth to the far value for the current convention.
+  void clear(const std::array<float, 3>& color);
+
+  // Record a draw of numVertices / 3 triangles transformed by the column-major modelViewProjection
+  // matrix.  The arrays must remain valid until finish() returns.
+  void drawTriangles(const float* positions, const float* colors, size_t numVertices,
+    const float modelViewProjection[16]);
+
+  // Record a draw of flat-shaded triangles, where triangle t has the color scaled by the brightness
+  // palette[t / trianglesPerEntry] / 255, as the palette shaders compute it.
+  void drawFlatTriangles(const float* positions, size_t numVertices, const uint8_t* palette,
+    size_t trianglesPerEntry, const std::array<float, 3>& color, const float modelViewProjection[16]);
+
+  // Render all recorded draws into the framebuffer.
+  void finish();
+
+  const Image& getImage() const { return image; }
+  size_t getTrianglesSubmitted() const { return trianglesSubmitted; }
+  size_t getTrianglesRasterized() const { return trianglesRasterized; }
+
+  // Triangle after clipping and setup, in pixel coordinates with the top row at y = 0.  Edge
+  // functions are evaluated relative to (originX, originY) to keep their magnitudes small.
+  struct Triangle {
+    float originX, originY;
+    float edgeA[3], edgeB[3], edgeC[3];   // E_k = A x + B y + C, equal to the area at vertex k
+    bool topLeft[3];                      // Whether pixels exactly on edge k are covered
+    float invArea;
+    float depth[3];                       // Window-space depth at each vertex
+    float invW[3];                        // 1/w at each vertex, for perspective-correct color
+    float color[3][3];
+    bool flat;                            // All vertex colors equal; packedColor is used
+    uint32_t packedColor;
+    int minX, minY, maxX, maxY;           // Inclusive pixel bounds, clamped to the framebuffer
+  };
+
+private:
+  struct Draw {
+    const float* positions;
+    const float* colors;
+    const uint8_t* palette;               // Used instead of colors when not null
+    size_t trianglesPerEntry;
+    std::array<float, 3> paletteColor;
+    size_t numTriangles;
+    std::array<float, 16> mvp;
+  };
+  struct Chunk {
+    size_t draw;
+    size_t firstTriangle;
+    size_t numTriangles;
+  };
+
+  void setupChunk(const Chunk& chunk, std::vector<Triangle>& out) const;
+  void rasterizeTile(size_t tile);
+
+  int width;
+  int height;
+  unsigned numThreads;
+  bool reversedZ = false;
+  int tilesX;
+  int tilesY;
+  Image image;
+  std::vector<float> depth;
+  std::vector<Draw> draws;
+  std::vector< std::vector<Triangle> > chunkTriangles;
+  std::vector< std::vector<const Triangle*> > bins;
+  size_t trianglesSubmitted = 0;
+  size_t trianglesRasterized = 0;
+};
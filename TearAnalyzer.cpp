@@ -0,0 +1,377 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include "MappedFile.h"
+#include "Parallel.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEARANALYZER_SSE2 1
+#endif
+
+//================================================================================================
+// Offline tear analyzer for captured footage.  It memory-maps a YUV4MPEG2 (.y4m) or headerless raw
+// video file and looks in each frame for horizontal discontinuities: rows that differ from the row
+// above much more than the neighboring rows differ from each other (and than the same rows did in the
+// previous frame), across a good part of the width.  That is what a tear looks like when the top and
+// bottom of a displayed frame come from different renderings.  Frames are analyzed in parallel and each
+// row difference is computed with SIMD sums of absolute differences.
+//
+// Other formats can be converted first, for example:  ffmpeg -i tearing.mp4 -f yuv4mpegpipe tearing.y4m
+
+//================================================================================================
+// Video layout: where each frame starts and which bytes of it to analyze.  For YUV formats only the
+// luma plane is used; for packed RGB formats every byte of the row is.
+
+struct VideoLayout {
+  int width = 0;
+  int height = 0;
+  size_t rowBytes = 0;          // Bytes of each row that are analyzed
+  size_t frameBytes = 0;        // Size of one frame's pixel data
+  std::vector<size_t> frameOffsets;
+};
+
+// Size in bytes of a frame in the named format, or 0 if the format is unknown.  The row length
+// analyzed is returned in rowBytes.
+static size_t frameSize(const std::string& format, int width, int height, size_t& rowBytes) {
+  size_t w = width, h = height;
+  size_t cw = (w + 1) / 2, ch = (h + 1) / 2;
+  rowBytes = w;
+  if (format == "gray" || format == "mono") { return w * h; }
+  if (format == "yuv420p" || format == "420") { return w * h + 2 * cw * ch; }
+  if (format == "yuv422p" || format == "422") { return w * h + 2 * cw * h; }
+  if (format == "yuv444p" || format == "444") { return w * h * 3; }
+  if (format == "rgb24") { rowBytes = w * 3; return w * h * 3; }
+  if (format == "rgba") { rowBytes = w * 4; return w * h * 4; }
+  return 0;
+}
+
+// The format of an 8-bit YUV4MPEG2 color space tag, ignoring the chroma siting of the 4:2:0 ones, or
+// an empty string for ones that are not supported: higher bit depths such as 420p10 and the alpha
+// plane of 444alpha change the frame size.
+static std::string y4mFormat(const std::string& colorSpace) {
+  if (colorSpace == "420" || colorSpace == "420jpeg" || colorSpace == "420mpeg2" || colorSpace == "420paldv") {
+    return "420";
+  }
+  if (colorSpace == "422" || colorSpace == "444" || colorSpace == "mono") {
+    return colorSpace;
+  }
+  return std::string();
+}
+
+// Parse a YUV4MPEG2 stream header and its FRAME markers.
+static VideoLayout parseY4M(const uint8_t* data, size_t size) {
+  VideoLayout layout;
+  const uint8_t* end = data + size;
+  const uint8_t* lineEnd = std::find(data, end, '\n');
+  if (lineEnd == end || size < 10 || std::memcmp(data, "YUV4MPEG2", 9) != 0) {
+    throw std::runtime_error("Not a YUV4MPEG2 file");
+  }
+  std::string colorSpace = "420";
+  std::string header(reinterpret_cast<const char*>(data), lineEnd - data);
+  size_t pos = 9;
+  while (pos < header.size()) {
+    size_t next = header.find(' ', pos + 1);
+    std::string token = header.substr(pos + 1, next == std::string::npos ? std::string::npos : next - pos - 1);
+    if (!token.empty()) {
+      switch (token[0]) {
+        case 'W': layout.width = std::atoi(token.c_str() + 1); break;
+        case 'H': layout.height = std::atoi(token.c_str() + 1); break;
+        case 'C': colorSpace = token.substr(1); break;
+        default: break;
+      }
+    }
+    pos = next == std::string::npos ? header.size() : next;
+  }
+  std::string format = y4mFormat(colorSpace);
+  if (format.empty()) {
+    throw std::runtime_error("Unsupported YUV4MPEG2 color space C" + colorSpace + " (only 8-bit 420, 422, 444 and mono)");
+  }
+  layout.frameBytes = frameSize(format, layout.width, layout.height, layout.rowBytes);
+  if (layout.width <= 0 || layout.height <= 0 || layout.frameBytes == 0) {
+    throw std::runtime_error("Unsupported YUV4MPEG2 header: " + header);
+  }
+
+  // Each frame is a "FRAME" line, possibly with parameters, followed by the pixel data.
+  const uint8_t* p = lineEnd + 1;
+  while (p + 5 <= end && std::memcmp(p, "FRAME", 5) == 0) {
+    const uint8_t* frameLineEnd = std::find(p, end, '\n');
+    if (frameLineEnd == end || static_cast<size_t>(end - frameLineEnd - 1) < layout.frameBytes) {
+      break;
+    }
+    layout.frameOffsets.push_back(frameLineEnd + 1 - data);
+    p = frameLineEnd + 1 + layout.frameBytes;
+  }
+  return layout;
+}
+
+// Describe a headerless raw file of back-to-back frames.
+static VideoLayout parseRaw(size_t size, int width, int height, const std::string& format) {
+  VideoLayout layout;
+  layout.width = width;
+  layout.height = height;
+  layout.frameBytes = frameSize(format, width, height, layout.rowBytes);
+  if (width <= 0 || height <= 0 || layout.frameBytes == 0) {
+    throw std::runtime_error("Unsupported raw format " + format);
+  }
+  for (size_t offset = 0; offset + layout.frameBytes <= size; offset += layout.frameBytes) {
+    layout.frameOffsets.push_back(offset);
+  }
+  return layout;
+}
+
+//================================================================================================
+// Row-difference metrics.
+
+// Sum of absolute differences between two byte ranges.
+static uint64_t sumAbsDiff(const uint8_t* a, const uint8_t* b, size_t n) {
+  uint64_t sum = 0;
+  size_t i = 0;
+#ifdef TEARANALYZER_SSE2
+  __m128i acc = _mm_setzero_si128();
+  for (; i + 16 <= n; i += 16) {
+    __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+  }
+  uint64_t parts[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(parts), acc);
+  sum = parts[0] + parts[1];
+#endif
+  for (; i < n; i++) {
+    sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+  }
+  return sum;
+}
+
+struct AnalyzerSettings {
+  int segments = 16;            // Column segments used to measure how much of the width is torn
+  int window = 8;               // Rows on each side used for the local baseline
+  double threshold = 4.0;       // Row difference relative to the local baseline that flags a row
+  double minDifference = 4.0;   // Minimum mean absolute difference per byte for a flagged row
+  double minCoverage = 0.25;    // Fraction of segments that must show the discontinuity
+  bool temporal = true;         // Also require the discontinuity to be absent from the previous frame
+};
+
+struct Tear {
+  int row;
+  double score;
+  double coverage;
+};
+
+// Pass 1: mean absolute difference of each row from the row above (row 0 is 0).
+static void computeRowDifferences(const uint8_t* frame, const VideoLayout& layout, float* rowDiff) {
+  rowDiff[0] = 0.0f;
+  for (int y = 1; y < layout.height; y++) {
+    uint64_t sad = sumAbsDiff(frame + (y - 1) * layout.rowBytes, frame + y * layout.rowBytes, layout.rowBytes);
+    rowDiff[y] = static_cast<float>(static_cast<double>(sad) / layout.rowBytes);
+  }
+}
+
+// Fraction of column segments in which row y differs from row y-1 much more than the neighboring row
+// pairs differ, so that content edges spanning only part of the width are not mistaken for tears.
+static double segmentCoverage(const uint8_t* frame, const VideoLayout& layout, const AnalyzerSettings& settings, int y) {
+  size_t segmentBytes = layout.rowBytes / settings.segments;
+  int covered = 0;
+  for (int s = 0; s < settings.segments; s++) {
+    size_t begin = s * segmentBytes;
+    size_t count = (s == settings.segments - 1) ? layout.rowBytes - begin : segmentBytes;
+    if (count == 0) { continue; }
+    double diff[3];
+    for (int k = 0; k < 3; k++) {
+      int r = y - 1 + k;
+      diff[k] = static_cast<double>(sumAbsDiff(frame + (r - 1) * layout.rowBytes + begin,
+        frame + r * layout.rowBytes + begin, count)) / count;
+    }
+    if (diff[1] > settings.threshold * (0.5 * (diff[0] + diff[2]) + 1.0)) {
+      covered++;
+    }
+  }
+  return static_cast<double>(covered) / settings.segments;
+}
+
+// Pass 2: find the rows of one frame where a tear begins.  A row is a candidate when its difference
+// from the row above stands out against the median of the nearby row differences and, if temporal
+// checking is on, against the same row pair in the previous frame (which rejects static edges in the
+// content).  neighbors is scratch space.
+static std::vector<Tear> findTears(const uint8_t* frame, const float* rowDiff, const float* previousRowDiff,
+  const VideoLayout& layout, const AnalyzerSettings& settings, std::vector<float>& neighbors) {
+  std::vector<Tear> tears;
+  const int window = settings.window;
+  for (int y = 2 + window; y < layout.height - window; y++) {
+    double d = rowDiff[y];
+    if (d < settings.minDifference) { continue; }
+
+    // Keep only the strongest row of a run of flagged rows.
+    if (rowDiff[y - 1] > d || rowDiff[y + 1] > d) { continue; }
+
+    neighbors.clear();
+    for (int k = -window; k <= window; k++) {
+      if (k != 0) { neighbors.push_back(rowDiff[y + k]); }
+    }
+    std::nth_element(neighbors.begin(), neighbors.begin() + neighbors.size() / 2, neighbors.end());
+    double baseline = neighbors[neighbors.size() / 2];
+    if (previousRowDiff) {
+      baseline = std::max(baseline, static_cast<double>(previousRowDiff[y]));
+    }
+    double score = d / (baseline + 1.0);
+    if (score < settings.threshold) { continue; }
+
+    double coverage = segmentCoverage(frame, layout, settings, y);
+    if (coverage < settings.minCoverage) { continue; }
+
+    Tear t;
+    t.row = y;
+    t.score = score;
+    t.coverage = coverage;
+    tears.push_back(t);
+  }
+  return tears;
+}
+
+//================================================================================================
+
+static void usage(const char* name) {
+  std::cerr << "Usage: " << name << " [options] <file.y4m | file.raw>" << std::endl;
+  std::cerr << "  --raw <width> <height>       Input is headerless raw video of this size" << std::endl;
+  std::cerr << "  --format <fmt>               Raw format: gray, yuv420p, yuv422p, yuv444p, rgb24, rgba (default yuv420p)" << std::endl;
+  std::cerr << "  --threshold <ratio>          Row difference over local baseline to flag a tear (default 4)" << std::endl;
+  std::cerr << "  --minDifference <value>      Minimum mean per-byte row difference of a tear (default 4)" << std::endl;
+  std::cerr << "  --coverage <fraction>        Fraction of the width that must be discontinuous (default 0.25)" << std::endl;
+  std::cerr << "  --segments <count>           Column segments used for coverage (default 16)" << std::endl;
+  std::cerr << "  --noTemporal                 Do not compare with the same rows of the previous frame" << std::endl;
+  std::cerr << "  --threads <count>            Analysis threads (default one per hardware thread)" << std::endl;
+  std::cerr << "  --output <file.csv>          Write per-frame tear rows to a CSV file" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  std::string inputFile;
+  std::string outputFile;
+  std::string format = "yuv420p";
+  int rawWidth = 0;
+  int rawHeight = 0;
+  bool raw = false;
+  unsigned numThreads = 0;
+  AnalyzerSettings settings;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--raw" && i + 2 < argc) {
+      raw = true;
+      rawWidth = std::stoi(argv[++i]);
+      rawHeight = std::stoi(argv[++i]);
+    } else if (arg == "--format" && i + 1 < argc) {
+      format = argv[++i];
+    } else if (arg == "--threshold" && i + 1 < argc) {
+      settings.threshold = std::stod(argv[++i]);
+    } else if (arg == "--minDifference" && i + 1 < argc) {
+      settings.minDifference = std::stod(argv[++i]);
+    } else if (arg == "--coverage" && i + 1 < argc) {
+      settings.minCoverage = std::stod(argv[++i]);
+    } else if (arg == "--segments" && i + 1 < argc) {
+      settings.segments = std::max(1, std::stoi(argv[++i]));
+    } else if (arg == "--noTemporal") {
+      settings.temporal = false;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      numThreads = static_cast<unsigned>(std::stoul(argv[++i]));
+    } else if (arg == "--output" && i + 1 < argc) {
+      outputFile = argv[++i];
+    } else if (arg[0] != '-' && inputFile.empty()) {
+      inputFile = arg;
+    } else {
+      std::cerr << "Unknown argument: " << arg << std::endl;
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (inputFile.empty()) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (numThreads == 0) { numThreads = defaultThreadCount(); }
+
+  try {
+    MappedFile file(inputFile, true);
+    VideoLayout layout = raw ? parseRaw(file.getSize(), rawWidth, rawHeight, format)
+                             : parseY4M(file.getData(), file.getSize());
+    if (layout.height < 2 * settings.window + 3) {
+      std::cerr << "Frames are too short to analyze" << std::endl;
+      return 2;
+    }
+    size_t numFrames = layout.frameOffsets.size();
+    std::cout << "Analyzing " << numFrames << " frames of " << layout.width << "x" << layout.height
+      << " with " << numThreads << " threads" << std::endl;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<float> rowDiffs(numFrames * layout.height);
+    parallelFor(numFrames, numThreads, [&](size_t f, unsigned) {
+      computeRowDifferences(file.getData() + layout.frameOffsets[f], layout, &rowDiffs[f * layout.height]);
+    });
+    std::vector< std::vector<Tear> > results(numFrames);
+    std::vector< std::vector<float> > scratch(numThreads);
+    parallelFor(numFrames, numThreads, [&](size_t f, unsigned thread) {
+      // The first frame has no predecessor, so it is checked against the second.
+      const float* previous = nullptr;
+      if (settings.temporal && numFrames > 1) {
+        previous = &rowDiffs[(f > 0 ? f - 1 : 1) * layout.height];
+      }
+      results[f] = findTears(file.getData() + layout.frameOffsets[f], &rowDiffs[f * layout.height], previous,
+        layout, settings, scratch[thread]);
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    // Per-frame output.
+    if (!outputFile.empty()) {
+      std::ofstream out(outputFile);
+      if (!out) {
+        std::cerr << "Could not open " << outputFile << " for writing" << std::endl;
+        return 3;
+      }
+      out << "frame,row,score,coverage" << std::endl;
+      for (size_t f = 0; f < numFrames; f++) {
+        for (const Tear& t : results[f]) {
+          out << f << "," << t.row << "," << t.score << "," << t.coverage << std::endl;
+        }
+      }
+    }
+
+    // Summary, including where in the frame tears happen in tenths of its height.
+    size_t tornFrames = 0;
+    size_t totalTears = 0;
+    std::vector<size_t> bands(10, 0);
+    for (size_t f = 0; f < numFrames; f++) {
+      if (results[f].empty()) { continue; }
+      tornFrames++;
+      totalTears += results[f].size();
+      for (const Tear& t : results[f]) {
+        bands[std::min<size_t>(9, static_cast<size_t>(t.row) * 10 / layout.height)]++;
+      }
+      if (outputFile.empty()) {
+        std::cout << "Frame " << f << ": tear at row";
+        for (const Tear& t : results[f]) { std::cout << " " << t.row; }
+        std::cout << std::endl;
+      }
+    }
+    std::cout << "Frames with tears: " << tornFrames << " of " << numFrames << " ("
+      << (numFrames ? 100.0 * tornFrames / numFrames : 0.0) << "%), " << totalTears << " tears" << std::endl;
+    std::cout << "Tear positions by tenth of frame height (top first):";
+    for (size_t b : bands) { std::cout << " " << b; }
+    std::cout << std::endl;
+    std::cout << "Analysis time: " << elapsed.count() << " seconds ("
+      << (elapsed.count() > 0 ? numFrames / elapsed.count() : 0.0) << " frames/s, "
+      << (elapsed.count() > 0 ? numFrames * layout.frameBytes / elapsed.count() / 1e6 : 0.0) << " MB/s)" << std::endl;
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 2;
+  }
+
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include "VertexCache.h"
+#include <algorithm>
+
+std::vector<uint32_t> optimizeVertexCache(const uint32_t* indices, size_t numIndices, size_t numVertices,
+  unsigned cacheSize) {
+  size_t numTriangles = numIndices / 3;
+  std::vector<uint32_t> result;
+  result.reserve(numTriangles * 3);
+  if (numTriangles == 0) { return result; }
+
+  // Triangles using each vertex, as offsets into one array.  live counts those not yet emitted.
+  std::vector<uint32_t> live(numVertices, 0);
+  for (size_t i = 0; i < numTriangles * 3; i++) {
+    live[indices[i]]++;
+  }
+  std::vector<size_t> offsets(numVertices + 1, 0);
+  for (size_t v = 0; v < numVertices; v++) {
+    offsets[v + 1] = offsets[v] + live[v];
+  }
+  std::vector<uint32_t> adjacency(offsets[numVertices]);
+  {
+    std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < numTriangles * 3; i++) {
+      adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+  }
+
+  // Time each vertex last entered the simulated cache, starting far enough in the past to be a miss.
+  std::vector<size_t> cacheTime(numVertices, 0);
+  size_t time = cacheSize + 1;
+  std::vector<bool> emitted(numTriangles, false);
+  std::vector<uint32_t> deadEnds;
+  std::vector<uint32_t> candidates;
+  size_t cursor = 0;
+
+  // Fan around one vertex at a time, emitting all of its remaining triangles.
+  long long fan = indices[0];
+  while (fan >= 0) {
+    candidates.clear();
+    for (size_t a = offsets[fan]; a < offsets[fan + 1]; a++) {
+      uint32_t t = adjacency[a];
+      if (emitted[t]) { continue; }
+      for (int k = 0; k < 3; k++) {
+        uint32_t v = indices[t * 3 + k];
+        result.push_back(v);
+        deadEnds.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cacheTime[v] > cacheSize) {
+          cacheTime[v] = time++;
+        }
+      }
+      emitted[t] = true;
+    }
+
+    // Next fan: the candidate still in the cache that entered it longest ago, provided its remaining
+    // triangles won't push it out, so that we use it before it is evicted.
+    fan = -1;
+    long long best = -1;
+    for (uint32_t v : candidates) {
+      if (live[v] == 0) { continue; }
+      long long priority = 0;
+      if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+        priority = static_cast<long long>(time - cacheTime[v]);
+      }
+      if (priority > best) {
+        best = priority;
+        fan = v;
+      }
+    }
+
+    // Dead end: go back to a recently used vertex with triangles left, then to any such vertex.
+    while (fan < 0 && !deadEnds.empty()) {
+      uint32_t v = deadEnds.back();
+      deadEnds.pop_back();
+      if (live[v] > 0) { fan = v; }
+    }
+    while (fan < 0 && cursor < numVertices) {
+      if (live[cursor] > 0) {
+        fan = static_cast<long long>(cursor);
+      }
+      cursor++;
+    }
+  }
+  return result;
+}
+
+VertexCacheStats simulateVertexCache(const uint32_t* indices, size_t numIndices, size_t numVertices,
+  unsigned cacheSize) {
+  VertexCacheStats stats;
+  stats.triangles = numIndices / 3;
+
+  // A vertex is in the cache if it was one of the last cacheSize misses.
+  std::vector<size_t> entered(numVertices, 0);
+  std::vector<bool> seen(numVertices, false);
+  for (size_t i = 0; i < stats.triangles * 3; i++) {
+    uint32_t v = indices[i];
+    if (!seen[v]) {
+      seen[v] = true;
+      stats.vertices++;
+    } else if (stats.misses - entered[v] <= cacheSize) {
+      continue;
+    }
+    entered[v] = stats.misses++;
+  }
+  return stats;
+}
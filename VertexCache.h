@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//================================================================================================
+// Post-transform vertex cache optimization for indexed triangle lists.  GPUs reuse the shaded
+// result of recently seen vertices, so the order in which triangles are submitted decides how often
+// each shared vertex is transformed.  The reordering keeps the vertex order within each triangle so
+// that the provoking vertex, and so flat-shaded color, is unchanged.
+
+struct VertexCacheStats {
+  size_t triangles = 0;
+  size_t vertices = 0;            // Distinct vertices referenced
+  size_t misses = 0;              // Vertices transformed, assuming a FIFO cache
+  double acmr() const { return triangles ? static_cast<double>(misses) / triangles : 0; }
+  double atvr() const { return vertices ? static_cast<double>(misses) / vertices : 0; }
+};
+
+// Reorder the triangles of an indexed list for a cache of cacheSize entries using Sander, Nehab and
+// Barczak's Tipsify algorithm, which runs in linear time.  numVertices must exceed every index.
+std::vector<uint32_t> optimizeVertexCache(const uint32_t* indices, size_t numIndices, size_t numVertices,
+  unsigned cacheSize);
+
+// Count the vertex transforms an indexed list needs with a FIFO cache of cacheSize entries.
+VertexCacheStats simulateVertexCache(const uint32_t* indices, size_t numIndices, size_t numVertices,
+  unsigned cacheSize);
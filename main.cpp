@@ -5,87 +5,683 @@
 #include <array>
 #include <memory>
 #include <cmath>
+#include <algorithm>
+#include <random>
+#include <functional>
+#include <utility>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include "DebugLog.h"
+#include "FrameHud.h"
+#include "GpuCulling.h"
+#include "Image.h"
+#include "ImageCompare.h"
+#include "LargePages.h"
+#include "LatencyProbe.h"
+#include "MeshCache.h"
+#include "OcclusionQueries.h"
+#include "RowChecksums.h"
+#include "Scheduling.h"
+#include "ShaderReloader.h"
+#include "ShaderUtils.h"
+#include "SoftwareRasterizer.h"
+#include "VertexCache.h"
+// Last, so that it redirects the GL calls in this file through the recorder.
+#include "GLRecorder.h"
 
 //================================================================================================
-// Vertex and fragment shader source code and functions to check for errors when building them.
+// Vertex and fragment shader source code.  Each quad has one brightness, stored as a byte, that scales
+// the plane's color.  These shaders are for indexed geometry, where it is a vertex attribute; the color
+// is flat so that each triangle takes it from its last vertex.
 
 static const GLchar* VertexShader =
 R"(#version 330 core
    layout(location = 0) in vec3 position;
-   layout(location = 1) in vec3 vertexColor;
-   out vec3 fragmentColor;
+   layout(location = 1) in float vertexBrightness;
+   flat out vec3 fragmentColor;
    uniform mat4 modelViewProjection;
+   uniform vec3 planeColor;
    void main()
    {
       gl_Position = modelViewProjection * vec4(position,1);
-      fragmentColor = vertexColor;
+      fragmentColor = planeColor * vertexBrightness;
    })";
 
 static const GLchar* FragmentShader =
 R"(#version 330 core
-   in vec3 fragmentColor;
+   flat in vec3 fragmentColor;
    out vec3 color;
    void main()
    {
        color = fragmentColor;
    })";
 
-void checkShaderError(GLuint shaderId, const std::string& exceptionMsg) {
-  GLint result = GL_FALSE;
-  int infoLength = 0;
-  glGetShaderiv(shaderId, GL_COMPILE_STATUS, &result);
-  glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLength);
-  if (result == GL_FALSE) {
-    std::vector<GLchar> errorMessage(infoLength + 1);
-    glGetShaderInfoLog(shaderId, infoLength, NULL, &errorMessage[0]);
-    std::cerr << &errorMessage[0] << std::endl;
-    throw std::runtime_error(exceptionMsg);
-  }
-}
+// Shaders for triangle list and strip geometry, which find each quad's brightness from the primitive
+// number.  Each row of quadsPerRow quads is two triangles per quad, and lodStep is the number of
+// full-detail quads each one spans, so the quad's full-detail brightness is found in a palette with
+// paletteStride quads per row.
+static const GLchar* PaletteVertexShader =
+R"(#version 330 core
+   layout(location = 0) in vec3 position;
+   uniform mat4 modelViewProjection;
+   void main()
+   {
+      gl_Position = modelViewProjection * vec4(position,1);
+   })";
 
-void checkProgramError(GLuint programId, const std::string& exceptionMsg) {
-  GLint result = GL_FALSE;
-  int infoLength = 0;
-  glGetProgramiv(programId, GL_LINK_STATUS, &result);
-  glGetProgramiv(programId, GL_INFO_LOG_LENGTH, &infoLength);
-  if (result == GL_FALSE) {
-    std::vector<GLchar> errorMessage(infoLength + 1);
-    glGetProgramInfoLog(programId, infoLength, NULL, &errorMessage[0]);
-    std::cerr << &errorMessage[0] << std::endl;
-    throw std::runtime_error(exceptionMsg);
-  }
-}
+static const GLchar* PaletteFragmentShader =
+R"(#version 330 core
+   uniform samplerBuffer palette;
+   uniform vec3 planeColor;
+   uniform int quadsPerRow;
+   uniform int paletteStride;
+   uniform int lodStep;
+   out vec3 color;
+   void main()
+   {
+       int quad = gl_PrimitiveID >> 1;
+       int row = quad / quadsPerRow;
+       int column = quad - row * quadsPerRow;
+       color = planeColor * texelFetch(palette, (row * paletteStride + column) * lodStep).r;
+   })";
+
+// Shaders for instances of one plane drawn with GpuCulling's indirect command.  Each instance finds its
+// matrix and color in storage buffers through the list of visible instances; viewProjection is shared.
+static const GLchar* InstancedVertexShader =
+R"(#version 430 core
+   layout(location = 0) in vec3 position;
+   layout(location = 1) in float vertexBrightness;
+   layout(std430, binding = 0) readonly buffer InstanceMatrices { mat4 instanceMatrix[]; };
+   layout(std430, binding = 1) readonly buffer InstanceColors { vec4 instanceColor[]; };
+   layout(std430, binding = 2) readonly buffer VisibleInstances { uint visibleInstance[]; };
+   flat out vec3 fragmentColor;
+   uniform mat4 viewProjection;
+   void main()
+   {
+      uint instance = visibleInstance[gl_InstanceID];
+      gl_Position = viewProjection * (instanceMatrix[instance] * vec4(position,1));
+      fragmentColor = instanceColor[instance].rgb * vertexBrightness;
+   })";
+
+static const GLchar* InstancedPaletteVertexShader =
+R"(#version 430 core
+   layout(location = 0) in vec3 position;
+   layout(std430, binding = 0) readonly buffer InstanceMatrices { mat4 instanceMatrix[]; };
+   layout(std430, binding = 1) readonly buffer InstanceColors { vec4 instanceColor[]; };
+   layout(std430, binding = 2) readonly buffer VisibleInstances { uint visibleInstance[]; };
+   flat out vec3 planeColor;
+   uniform mat4 viewProjection;
+   void main()
+   {
+      uint instance = visibleInstance[gl_InstanceID];
+      gl_Position = viewProjection * (instanceMatrix[instance] * vec4(position,1));
+      planeColor = instanceColor[instance].rgb;
+   })";
+
+// gl_PrimitiveID restarts from zero for each instance, so the palette lookup is unchanged.
+static const GLchar* InstancedPaletteFragmentShader =
+R"(#version 430 core
+   uniform samplerBuffer palette;
+   flat in vec3 planeColor;
+   uniform int quadsPerRow;
+   uniform int paletteStride;
+   uniform int lodStep;
+   out vec3 color;
+   void main()
+   {
+       int quad = gl_PrimitiveID >> 1;
+       int row = quad / quadsPerRow;
+       int column = quad - row * quadsPerRow;
+       color = planeColor * texelFetch(palette, (row * paletteStride + column) * lodStep).r;
+   })";
 
 //================================================================================================
 // Class to generate and draw colored geometry with internal patches.
 
+// How a plane's triangles are laid out in its buffers.
+enum class MeshGeometry {
+  List,       // Six vertices per quad, with the quads' brightnesses in a palette.
+  Indexed,    // A shared grid of vertices with index ranges for each level of detail.
+  Strips      // The same grid drawn as one triangle strip per row, joined by primitive restart.
+};
+
 class MeshPlane {
 public:
-  MeshPlane(GLfloat scale, size_t numTriangles = 2 * 15 * 15, std::array<float,3> color = {1, 1, 1}) {
+  // The seed selects the random brightness pattern.  If packedPositions is set and the grid is small
+  // enough (see canPackPositions()), positions are stored as packed 10-bit integers.  If cacheDirectory
+  // is not empty, the mesh is mapped from a cache entry there when one exists, and otherwise generated
+  // and written to one.
+  MeshPlane(GLfloat scale, size_t numTriangles = 2 * 15 * 15, std::array<float,3> color = {1, 1, 1},
+    unsigned seed = 0, MeshGeometry geometry = MeshGeometry::List, bool packedPositions = false,
+    const std::string& cacheDirectory = "")
+    : extent(scale), planeColor(color), geometry(geometry),
+      packedPositions(packedPositions && canPackPositions(numTriangles)) {
+    // Packed positions hold grid coordinates offset by PackedOffset, which this matrix maps to the plane.
+    size_t n = quadsPerEdge(numTriangles);
+    GLfloat spacing = 2 * scale / n;
+    positionMatrix = {{ spacing, 0, 0, 0,  0, spacing, 0, 0,  0, 0, 1, 0,
+      -scale + PackedOffset * spacing, -scale + PackedOffset * spacing, 0, 1 }};
+
+    MeshKey key;
+    key.scale = scale;
+    key.numTriangles = numTriangles;
+    key.color = color;
+    key.seed = seed;
+    key.geometry = static_cast<uint32_t>(geometry);
+    key.packedPositions = this->packedPositions ? 1 : 0;
+    if (!cacheDirectory.empty()) {
+      cacheEntry = MeshCacheEntry::open(cacheDirectory, key);
+      if (cacheEntry && mapCacheEntry()) {
+        return;
+      }
+      cacheEntry.reset();
+    }
+
+    if (geometry == MeshGeometry::List) {
+      generate(scale, numTriangles, seed);
+    } else {
+      generateIndexed(scale, numTriangles, seed);
+      indexData = indexBufferData.data();
+      numIndices = indexBufferData.size();
+    }
+    numVertices = vertexBufferData.size() / 3;
+    if (this->packedPositions) {
+      packPositions(scale, n);
+    }
+    vertexData = this->packedPositions ? nullptr : vertexBufferData.data();
+    packedVertexData = this->packedPositions ? packedVertexBufferData.data() : nullptr;
+    colorData = colorBufferData.data();
+    numColors = colorBufferData.size();
+
+    if (!cacheDirectory.empty()) {
+      std::vector<MeshSection> sections = {
+        { MeshSectionPositions, getPositionData(), getPositionBytes() },
+        { MeshSectionColors, colorData, numColors } };
+      if (geometry != MeshGeometry::List) {
+        sections.push_back({ MeshSectionIndices, indexData, numIndices * sizeof(GLuint) });
+        sections.push_back({ MeshSectionLevels, levels.data(), levels.size() * sizeof(LodLevel) });
+      }
+      MeshCacheEntry::write(cacheDirectory, key, sections);
+    }
+  }
+
+  ~MeshPlane() {
+    // Vertex array objects belong to the context that made them, so only the current context's can be
+    // deleted here.  The others go away with their contexts.
+    GLFWwindow* context = glfwGetCurrentContext();
+    for (const auto& va : vertexArrays) {
+      if (va.first == context) {
+        glDeleteVertexArrays(1, &va.second);
+      }
+    }
+    if (initialized) {
+      glDeleteBuffers(1, &vertexBuffer);
+      glDeleteBuffers(1, &colorBuffer);
+      if (indexBuffer) {
+        glDeleteBuffers(1, &indexBuffer);
+      }
+      if (paletteTexture) {
+        glDeleteTextures(1, &paletteTexture);
+      }
+    }
+  }
+
+  // Use ARB_direct_state_access to create and fill buffers without binding them, and to record the
+  // vertex layout in a vertex array object per context.  Set once after the first context is made current.
+  static bool directStateAccess;
+
+  void init() {
+    if (!initialized) {
+      if (directStateAccess) {
+        initDirectStateAccess();
+      } else {
+        initBound();
+      }
+      initialized = true;
+    }
+  }
+
+  // Draw the given level of detail, where 0 is the full tessellation.  List geometry only has level 0.
+  void draw(size_t level = 0) {
+    init();
+    bindArrays();
+    submit(level, false);
+  }
+
+  // Draw instances of the full tessellation with the command at the start of the indirect buffer, as
+  // written by GpuCulling.  The instances are placed and colored by the shaders.
+  void drawIndirect(GLuint commandBuffer) {
+    init();
+    bindArrays();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+    submit(0, true);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+  }
+
+  // The indirect command that draws the full tessellation once: a DrawElementsIndirectCommand for indexed
+  // and strip geometry, otherwise a DrawArraysIndirectCommand followed by an unused word.
+  std::array<GLuint, 5> getIndirectCommand() const {
+    if (geometry == MeshGeometry::List) {
+      return {{ static_cast<GLuint>(numVertices), 1, 0, 0, 0 }};
+    }
+    return {{ levels[0].numIndices, 1, levels[0].firstIndex, 0, 0 }};
+  }
+
+  // Choose the finest level of detail whose triangle count fits a budget of one triangle per
+  // pixelsPerTriangle pixels of the area the plane covers on a width x height viewport under the given
+  // transform, so each triangle covers at least that many pixels on average.  The coarsest level is
+  // used if none fits, and planes crossing the eye plane get the full tessellation.
+  size_t selectLevel(const float modelViewProjection[16], int width, int height, float pixelsPerTriangle) const {
+    if (levels.size() <= 1) { return 0; }
+
+    // Project the corners of the plane to pixels.
+    const float corners[4][2] = { { -extent, -extent }, { extent, -extent }, { extent, extent }, { -extent, extent } };
+    float px[4], py[4];
+    const float* m = modelViewProjection;
+    for (int c = 0; c < 4; c++) {
+      float x = m[0] * corners[c][0] + m[4] * corners[c][1] + m[12];
+      float y = m[1] * corners[c][0] + m[5] * corners[c][1] + m[13];
+      float w = m[3] * corners[c][0] + m[7] * corners[c][1] + m[15];
+      if (w <= 1e-6f) { return 0; }
+      px[c] = (x / w * 0.5f + 0.5f) * width;
+      py[c] = (y / w * 0.5f + 0.5f) * height;
+    }
+
+    // Shoelace area of the projected quad, which can't usefully exceed the viewport.
+    double area = 0;
+    for (int c = 0; c < 4; c++) {
+      int n = (c + 1) % 4;
+      area += static_cast<double>(px[c]) * py[n] - static_cast<double>(px[n]) * py[c];
+    }
+    area = std::min(std::fabs(area) * 0.5, static_cast<double>(width) * height);
+
+    double triangleBudget = area / pixelsPerTriangle;
+    for (size_t l = 0; l < levels.size(); l++) {
+      if (levels[l].numTriangles() <= triangleBudget) { return l; }
+    }
+    return levels.size() - 1;
+  }
+
+  // Non-indexed triangle-list vertex positions, three floats each, and one brightness byte per quad in
+  // row order, which scales the plane color.  These point either into our own arrays or into a mapped
+  // cache entry.  For indexed geometry they hold the shared grid, where each vertex carries the
+  // brightness of the quad it is the provoking (last) vertex of.
+  const GLfloat* getVertexData() const { return vertexData; }   // nullptr if positions are packed
+  const uint8_t* getBrightnessData() const { return colorData; }
+  const std::array<float,3>& getColor() const { return planeColor; }
+  GLsizei getNumVertices() const { return static_cast<GLsizei>(numVertices); }
+  size_t getPositionBytes() const { return numVertices * (packedPositions ? sizeof(uint32_t) : 3 * sizeof(GLfloat)); }
+  bool hasPackedPositions() const { return packedPositions; }
+
+  // Packed positions are exact grid coordinates in signed 10-bit fields, so grids of up to 1023 quads
+  // per edge (about two million triangles) can use them.
+  static bool canPackPositions(size_t numTriangles) {
+    return quadsPerEdge(numTriangles) <= static_cast<size_t>(2 * PackedOffset - 1);
+  }
+
+  // The matrix to draw with: the model-view-projection matrix, preceded for packed positions by the
+  // mapping from grid coordinates to the plane.
+  void applyPositionMatrix(const float modelViewProjection[16], float result[16]) const {
+    std::copy(modelViewProjection, modelViewProjection + 16, result);
+    if (packedPositions) {
+      const float* p = positionMatrix.data();
+      for (int r = 0; r < 4; r++) {
+        result[r] = modelViewProjection[r] * p[0];
+        result[4 + r] = modelViewProjection[4 + r] * p[5];
+        result[12 + r] = modelViewProjection[r] * p[12] + modelViewProjection[4 + r] * p[13] +
+          modelViewProjection[12 + r];
+      }
+    }
+  }
+  // The x and y minima then maxima of the plane in the coordinates its positions are stored in, which
+  // applyPositionMatrix() maps to the plane.
+  std::array<float,4> getPositionBounds() const {
+    if (!packedPositions) { return {{ -extent, -extent, extent, extent }}; }
+    float low = (-extent - positionMatrix[12]) / positionMatrix[0];
+    float high = (extent - positionMatrix[12]) / positionMatrix[0];
+    return {{ low, low, high, high }};
+  }
+  bool isFromCache() const { return cacheEntry != nullptr; }
+  MeshGeometry getGeometry() const { return geometry; }
+  size_t getNumLevels() const { return geometry == MeshGeometry::List ? 1 : levels.size(); }
+  size_t getNumTriangles(size_t level = 0) const {
+    if (geometry == MeshGeometry::List) { return numVertices / 3; }
+    return levels[std::min(level, levels.size() - 1)].numTriangles();
+  }
+  size_t getNumIndices(size_t level = 0) const {
+    if (geometry == MeshGeometry::List) { return 0; }
+    return levels[std::min(level, levels.size() - 1)].numIndices;
+  }
+
+  // The indices drawing a level of indexed or strip geometry.
+  const GLuint* getIndexData(size_t level = 0) const {
+    return indexData + levels[std::min(level, levels.size() - 1)].firstIndex;
+  }
+
+  // Post-transform cache size that indexed geometry is ordered for.  16 entries is at or below what
+  // current GPUs provide, and Tipsify degrades gracefully on larger caches.
+  static const unsigned VertexCacheSize = 16;
+
+  static size_t quadsPerEdge(size_t numTriangles) {
     // Figure out how many quads we have per edge.  There
     // is a minimum of 1.
     size_t numQuads = numTriangles / 2;
     size_t numQuadsPerEdge = static_cast<size_t> (sqrt(numQuads));
     if (numQuadsPerEdge < 1) { numQuadsPerEdge = 1; }
+    return numQuadsPerEdge;
+  }
+
+  // Quads covering step x step cells of an n x n grid of (n+1) x (n+1) vertices, in row order, two
+  // triangles each.  Both triangles end with the quad's lower-left vertex, which provokes its color.
+  static std::vector<GLuint> gridIndices(size_t n, size_t step) {
+    std::vector<GLuint> indices;
+    size_t rowVertices = n + 1;
+    for (size_t i0 = 0; i0 < n; i0 += step) {
+      size_t i1 = std::min(i0 + step, n);
+      for (size_t j0 = 0; j0 < n; j0 += step) {
+        size_t j1 = std::min(j0 + step, n);
+        GLuint v00 = static_cast<GLuint>(i0 * rowVertices + j0);
+        GLuint v10 = static_cast<GLuint>(i1 * rowVertices + j0);
+        GLuint v01 = static_cast<GLuint>(i0 * rowVertices + j1);
+        GLuint v11 = static_cast<GLuint>(i1 * rowVertices + j1);
+        GLuint quad[6] = { v10, v11, v00, v11, v01, v00 };
+        indices.insert(indices.end(), quad, quad + 6);
+      }
+    }
+    return indices;
+  }
+
+private:
+  MeshPlane(const MeshPlane&) = delete;
+  MeshPlane& operator=(const MeshPlane&) = delete;
+
+  // A range of the index buffer drawing one level of detail, whose quads cover step x step grid cells.
+  // Stored as-is in the mesh cache.
+  struct LodLevel {
+    uint32_t firstIndex;
+    uint32_t numIndices;
+    uint32_t quadsPerRow;
+    uint32_t step;
+    size_t numTriangles() const { return 2 * static_cast<size_t>(quadsPerRow) * quadsPerRow; }
+  };
+
+  // Index that separates the rows of strip geometry.
+  static const GLuint RestartIndex = 0xFFFFFFFFu;
+
+  // Set up the vertex attributes and element buffer for drawing.
+  void bindArrays() {
+    if (directStateAccess) {
+      // The attribute formats, buffers and element buffer are all recorded in the vertex array object.
+      glBindVertexArray(getVertexArray());
+    } else {
+      // Unbind any currently bound vertex array object.
+      // We cannot share vertex array objects because we're potentially going to be called
+      // from multiple OpenGL contexts in different threads and VAOs are not shared between
+      // contexts, so this path sets up the attributes on every draw.
+      glBindVertexArray(0);
+
+      // Enable the vertex attribute arrays we are going to use
+      glEnableVertexAttribArray(0);
+
+      // Bind the vertex buffer object
+      glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+      if (packedPositions) {
+        glVertexAttribPointer(0, 4, GL_INT_2_10_10_10_REV, GL_FALSE, 0, (GLvoid*)0);
+      } else {
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+      }
+
+      if (geometry == MeshGeometry::Indexed) {
+        // Bind the brightness buffer object, one normalized byte per vertex
+        glEnableVertexAttribArray(1);
+        glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+        glVertexAttribPointer(1, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0, (GLvoid*)0);
+      } else {
+        // Lists and strips look up each quad's brightness by primitive number, so they need no attribute.
+        glDisableVertexAttribArray(1);
+      }
+      if (geometry != MeshGeometry::List) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+      }
+    }
+  }
+
+  // Draw a level of detail, or with the bound indirect buffer's command.
+  void submit(size_t level, bool indirect) {
+    const LodLevel& l = levels.empty() ? LodLevel() : levels[std::min(level, levels.size() - 1)];
+    if (geometry == MeshGeometry::Indexed) {
+      setColorUniforms(nullptr);
+      if (indirect) {
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)0);
+      } else {
+        glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(l.numIndices), GL_UNSIGNED_INT,
+          (GLvoid*)(sizeof(GLuint) * l.firstIndex));
+      }
+      return;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+    if (geometry == MeshGeometry::Strips) {
+      setColorUniforms(&l);
+      glEnable(GL_PRIMITIVE_RESTART);
+      glPrimitiveRestartIndex(RestartIndex);
+      if (indirect) {
+        glDrawElementsIndirect(GL_TRIANGLE_STRIP, GL_UNSIGNED_INT, (GLvoid*)0);
+      } else {
+        glDrawElements(GL_TRIANGLE_STRIP, static_cast<GLsizei>(l.numIndices), GL_UNSIGNED_INT,
+          (GLvoid*)(sizeof(GLuint) * l.firstIndex));
+      }
+      glDisable(GL_PRIMITIVE_RESTART);
+    } else {
+      LodLevel full;
+      full.quadsPerRow = static_cast<uint32_t>(paletteStride);
+      full.step = 1;
+      setColorUniforms(&full);
+      if (indirect) {
+        glDrawArraysIndirect(GL_TRIANGLES, (GLvoid*)0);
+      } else {
+        glDrawArrays(GL_TRIANGLES, 0, getNumVertices());
+      }
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+  }
+
+  // Create the buffers by binding them to edit, for contexts without direct state access.
+  void initBound() {
+    // Unbind any vertex array object.
+    glBindVertexArray(0);
+
+    // Vertex buffer
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER,
+      getPositionBytes(),
+      getPositionData(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Brightness buffer, which lists and strips read as a texture buffer of quad brightnesses
+    glGenBuffers(1, &colorBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
+    glBufferData(GL_ARRAY_BUFFER,
+      numColors,
+      colorData, GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (geometry != MeshGeometry::Indexed) {
+      glGenTextures(1, &paletteTexture);
+      glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+      glTexBuffer(GL_TEXTURE_BUFFER, GL_R8, colorBuffer);
+      glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Index buffer holding every level of detail
+    if (geometry != MeshGeometry::List) {
+      glGenBuffers(1, &indexBuffer);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+        sizeof(GLuint) * numIndices,
+        indexData, GL_STATIC_DRAW);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+  }
+
+  // Create the same objects with direct state access.  The meshes never change, so the buffers get
+  // immutable storage, which also lets the driver place them without guessing from a usage hint.
+  // Nothing is bound, so whatever state the caller had is left alone.
+  void initDirectStateAccess() {
+    glCreateBuffers(1, &vertexBuffer);
+    glNamedBufferStorage(vertexBuffer, getPositionBytes(), getPositionData(), 0);
+
+    glCreateBuffers(1, &colorBuffer);
+    glNamedBufferStorage(colorBuffer, numColors, colorData, 0);
+    if (geometry != MeshGeometry::Indexed) {
+      glCreateTextures(GL_TEXTURE_BUFFER, 1, &paletteTexture);
+      glTextureBuffer(paletteTexture, GL_R8, colorBuffer);
+    }
+
+    if (geometry != MeshGeometry::List) {
+      glCreateBuffers(1, &indexBuffer);
+      glNamedBufferStorage(indexBuffer, sizeof(GLuint) * numIndices, indexData, 0);
+    }
+  }
+
+  // Find the current context's vertex array object, creating it on first use.  Buffers are shared
+  // between our contexts but vertex array objects are not, so each context gets its own.
+  GLuint getVertexArray() {
+    GLFWwindow* context = glfwGetCurrentContext();
+    for (const auto& va : vertexArrays) {
+      if (va.first == context) {
+        return va.second;
+      }
+    }
+
+    GLuint vao = 0;
+    glCreateVertexArrays(1, &vao);
+    if (packedPositions) {
+      glVertexArrayVertexBuffer(vao, 0, vertexBuffer, 0, sizeof(uint32_t));
+      glVertexArrayAttribFormat(vao, 0, 4, GL_INT_2_10_10_10_REV, GL_FALSE, 0);
+    } else {
+      glVertexArrayVertexBuffer(vao, 0, vertexBuffer, 0, 3 * sizeof(GLfloat));
+      glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+    }
+    glVertexArrayAttribBinding(vao, 0, 0);
+    glEnableVertexArrayAttrib(vao, 0);
+    if (geometry == MeshGeometry::Indexed) {
+      glVertexArrayVertexBuffer(vao, 1, colorBuffer, 0, sizeof(uint8_t));
+      glVertexArrayAttribFormat(vao, 1, 1, GL_UNSIGNED_BYTE, GL_TRUE, 0);
+      glVertexArrayAttribBinding(vao, 1, 1);
+      glEnableVertexArrayAttrib(vao, 1);
+    }
+    if (geometry != MeshGeometry::List) {
+      glVertexArrayElementBuffer(vao, indexBuffer);
+    }
+    vertexArrays.push_back(std::make_pair(context, vao));
+    return vao;
+  }
+
+  // Set the plane color and, for palette lookups, the layout of the level being drawn.  The palette
+  // shaders find each quad from gl_PrimitiveID, which counts triangles through the whole draw regardless
+  // of restarts.  Uniform locations are looked up again whenever the program changes.
+  void setColorUniforms(const LodLevel* l) {
+    GLint program = 0;
+    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+    if (static_cast<GLuint>(program) != uniformProgram) {
+      uniformProgram = static_cast<GLuint>(program);
+      planeColorUniform = glGetUniformLocation(uniformProgram, "planeColor");
+      quadsPerRowUniform = glGetUniformLocation(uniformProgram, "quadsPerRow");
+      paletteStrideUniform = glGetUniformLocation(uniformProgram, "paletteStride");
+      lodStepUniform = glGetUniformLocation(uniformProgram, "lodStep");
+      paletteUniform = glGetUniformLocation(uniformProgram, "palette");
+    }
+    glUniform3f(planeColorUniform, planeColor[0], planeColor[1], planeColor[2]);
+    if (l) {
+      glUniform1i(quadsPerRowUniform, static_cast<GLint>(l->quadsPerRow));
+      glUniform1i(paletteStrideUniform, static_cast<GLint>(paletteStride));
+      glUniform1i(lodStepUniform, static_cast<GLint>(l->step));
+      glUniform1i(paletteUniform, 0);
+    }
+  }
+
+  // Point our arrays into the cache entry, returning false if it does not hold a complete mesh.
+  bool mapCacheEntry() {
+    size_t vertexBytes = 0, colorBytes = 0;
+    const void* positions = cacheEntry->getSection(MeshSectionPositions, vertexBytes);
+    colorData = static_cast<const uint8_t*>(cacheEntry->getSection(MeshSectionColors, colorBytes));
+    if (!positions || !colorData) { return false; }
+    if (packedPositions) {
+      packedVertexData = static_cast<const uint32_t*>(positions);
+      numVertices = vertexBytes / sizeof(uint32_t);
+    } else {
+      vertexData = static_cast<const GLfloat*>(positions);
+      numVertices = vertexBytes / (3 * sizeof(GLfloat));
+    }
+    numColors = colorBytes;
+    if (geometry == MeshGeometry::List) {
+      paletteStride = static_cast<size_t>(std::sqrt(static_cast<double>(numColors)) + 0.5);
+      return paletteStride * paletteStride == numColors && numColors * 6 == numVertices;
+    }
+
+    size_t indexBytes = 0, levelBytes = 0;
+    indexData = static_cast<const GLuint*>(cacheEntry->getSection(MeshSectionIndices, indexBytes));
+    const LodLevel* levelBegin = static_cast<const LodLevel*>(cacheEntry->getSection(MeshSectionLevels, levelBytes));
+    numIndices = indexBytes / sizeof(GLuint);
+    if (!indexData || !levelBegin || levelBytes < sizeof(LodLevel)) { return false; }
+    levels.assign(levelBegin, levelBegin + levelBytes / sizeof(LodLevel));
+    for (const LodLevel& l : levels) {
+      if (l.firstIndex > numIndices || l.numIndices > numIndices - l.firstIndex) { return false; }
+    }
+    // A stale or damaged entry must not make the draws read past the vertices.
+    for (size_t i = 0; i < numIndices; i++) {
+      if (indexData[i] >= numVertices && indexData[i] != RestartIndex) { return false; }
+    }
+    paletteStride = levels[0].quadsPerRow;
+    if (geometry == MeshGeometry::Strips) {
+      return numColors == levels[0].numTriangles() / 2;
+    }
+    return numColors == numVertices;
+  }
+
+  const void* getPositionData() const {
+    return packedPositions ? static_cast<const void*>(packedVertexData) : static_cast<const void*>(vertexData);
+  }
+
+  // Replace the float positions of an n x n quad grid by their grid coordinates, less PackedOffset, in
+  // the x and y fields of GL_INT_2_10_10_10_REV values.
+  void packPositions(GLfloat scale, size_t n) {
+    packedVertexBufferData.resize(numVertices);
+    for (size_t v = 0; v < numVertices; v++) {
+      uint32_t packed = 0;
+      for (int c = 0; c < 2; c++) {
+        long i = std::lround((vertexBufferData[v * 3 + c] + scale) * n / (2 * scale));
+        packed |= (static_cast<uint32_t>(i - PackedOffset) & 0x3ff) << (10 * c);
+      }
+      packedVertexBufferData[v] = packed;
+    }
+    LargePageVector<GLfloat>().swap(vertexBufferData);
+  }
+
+  // Modulate the brightness of each quad by a random luminance between half and full, leaving all
+  // quads the same hue.  Brightnesses are bytes, so every layout and the CPU renderer scale the plane
+  // color by exactly the same value.  We use our own generator, whose sequence is fully specified, so
+  // each plane's pattern depends only on its seed and is the same on every platform.
+  static uint8_t nextBrightness(std::minstd_rand& random) {
+    const GLfloat randomRange = static_cast<GLfloat>(std::minstd_rand::max() - std::minstd_rand::min());
+    GLfloat brightness = 0.5f + (random() - std::minstd_rand::min()) * 0.5f / randomRange;
+    return static_cast<uint8_t>(brightness * 255.0f + 0.5f);
+  }
+
+  void generate(GLfloat scale, size_t numTriangles, unsigned seed) {
+    size_t numQuadsPerEdge = quadsPerEdge(numTriangles);
+    paletteStride = numQuadsPerEdge;
+    vertexBufferData.reserve(numQuadsPerEdge * numQuadsPerEdge * 18);
+    colorBufferData.reserve(numQuadsPerEdge * numQuadsPerEdge);
+    std::minstd_rand random(seed + 1);
 
     // Construct a square with the specified number of
     // quads a plane in Z.
     for (size_t i = 0; i < numQuadsPerEdge; i++) {
       for (size_t j = 0; j < numQuadsPerEdge; j++) {
-
-        // Modulate the brightness of each quad by a random luminance,
-        // leaving all vertices the same hue.
-        GLfloat brightness = 0.5f + rand() * 0.5f / RAND_MAX;
-        const size_t numTris = 2;
-        const size_t numColors = 3;
-        const size_t numVerts = 3;
-        for (size_t c = 0; c < numTris * numVerts; c++) {
-          for (size_t i = 0; i < numColors; i++) {
-            colorBufferData.push_back(brightness * color[i]);
-          }
-        }
+        colorBufferData.push_back(nextBrightness(random));
 
         // Send the two triangles that make up this quad, where the
         // quad covers the appropriate fraction of the face from
@@ -122,71 +718,202 @@ public:
     }
   }
 
-  ~MeshPlane() {
-    if (initialized) {
-      glDeleteBuffers(1, &vertexBuffer);
-      glDeleteBuffers(1, &colorBuffer);
+  // Build the same plane as a grid of (n+1) x (n+1) shared vertices, with index ranges for each level
+  // of detail.  Level L steps 2^L grid cells per quad.  Each quad's lower-left vertex holds its
+  // brightness, so flat shading with the default last-vertex convention colors every quad exactly as
+  // the triangle list does; coarser levels take the color of the first fine quad they cover.  Strips use
+  // the same vertices with a palette like the triangle list's, since a strip's provoking vertices are
+  // shared between quads of different colors.
+  void generateIndexed(GLfloat scale, size_t numTriangles, unsigned seed) {
+    size_t n = quadsPerEdge(numTriangles);
+    size_t rowVertices = n + 1;
+    paletteStride = n;
+    vertexBufferData.resize(rowVertices * rowVertices * 3);
+
+    // Draw the brightnesses in the same order as generate() so that both layouts match.
+    std::minstd_rand random(seed + 1);
+    if (geometry == MeshGeometry::Strips) {
+      colorBufferData.resize(n * n);
+      for (size_t q = 0; q < n * n; q++) {
+        colorBufferData[q] = nextBrightness(random);
+      }
+    } else {
+      colorBufferData.resize(rowVertices * rowVertices);
+      for (size_t i = 0; i < n; i++) {
+        for (size_t j = 0; j < n; j++) {
+          colorBufferData[i * rowVertices + j] = nextBrightness(random);
+        }
+      }
     }
-  }
 
-  void init() {
-    if (!initialized) {
-      // Unbind any vertex array object.
-      glBindVertexArray(0);
+    for (size_t i = 0; i <= n; i++) {
+      for (size_t j = 0; j <= n; j++) {
+        GLfloat* v = &vertexBufferData[(i * rowVertices + j) * 3];
+        v[0] = -scale + i * (2 * scale) / n;
+        v[1] = -scale + j * (2 * scale) / n;
+        v[2] = 0.0f;
 
-      // Vertex buffer
-      glGenBuffers(1, &vertexBuffer);
-      glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-      glBufferData(GL_ARRAY_BUFFER,
-        sizeof(vertexBufferData[0]) * vertexBufferData.size(),
-        vertexBufferData.data(), GL_STATIC_DRAW);
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-      // Color buffer
-      glGenBuffers(1, &colorBuffer);
-      glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
-      glBufferData(GL_ARRAY_BUFFER,
-        sizeof(colorBufferData[0]) * colorBufferData.size(),
-        colorBufferData.data(), GL_STATIC_DRAW);
-      glBindBuffer(GL_ARRAY_BUFFER, 0);
+        // Vertices on the far edges never provoke a triangle; give them their neighbor's brightness.
+        if ((i == n || j == n) && geometry != MeshGeometry::Strips) {
+          colorBufferData[i * rowVertices + j] = colorBufferData[std::min(i, n - 1) * rowVertices + std::min(j, n - 1)];
+        }
+      }
+    }
 
-      initialized = true;
+    // Each level's triangles are reordered for the post-transform vertex cache, unless the row order
+    // already does better, as it can on the coarsest levels.  Strips must stay in row order for the
+    // shader to find each quad's brightness.
+    size_t numVertices = rowVertices * rowVertices;
+    for (size_t step = 1; ; step *= 2) {
+      std::vector<GLuint> optimized;
+      if (geometry == MeshGeometry::Strips) {
+        optimized = stripIndices(n, step);
+      } else {
+        std::vector<GLuint> grid = gridIndices(n, step);
+        optimized = optimizeVertexCache(grid.data(), grid.size(), numVertices, VertexCacheSize);
+        if (simulateVertexCache(grid.data(), grid.size(), numVertices, VertexCacheSize).misses <
+            simulateVertexCache(optimized.data(), optimized.size(), numVertices, VertexCacheSize).misses) {
+          optimized.swap(grid);
+        }
+      }
+      LodLevel level;
+      level.firstIndex = static_cast<uint32_t>(indexBufferData.size());
+      level.numIndices = static_cast<uint32_t>(optimized.size());
+      level.quadsPerRow = static_cast<uint32_t>((n + step - 1) / step);
+      level.step = static_cast<uint32_t>(step);
+      indexBufferData.insert(indexBufferData.end(), optimized.begin(), optimized.end());
+      levels.push_back(level);
+      if (step >= n) { break; }
     }
   }
 
-  void draw() {
-    init();
+  // One strip per row of quads covering step x step cells, with a restart index between rows.  The two
+  // triangles of each quad are consecutive, so quad q of the draw is primitive 2q or 2q + 1.
+  static std::vector<GLuint> stripIndices(size_t n, size_t step) {
+    std::vector<GLuint> indices;
+    size_t rowVertices = n + 1;
+    for (size_t i0 = 0; i0 < n; i0 += step) {
+      size_t i1 = std::min(i0 + step, n);
+      if (i0 > 0) {
+        indices.push_back(RestartIndex);
+      }
+      for (size_t j0 = 0; ; j0 += step) {
+        size_t j = std::min(j0, n);
+        indices.push_back(static_cast<GLuint>(i1 * rowVertices + j));
+        indices.push_back(static_cast<GLuint>(i0 * rowVertices + j));
+        if (j == n) { break; }
+      }
+    }
+    return indices;
+  }
 
-    // Unbind any currently bound vertex array object.
-    // We cannot use vertex array objects because we're potentially going to be called
-    // from multiple OpenGL contexts in different threads and VAOs are not shared between
-    // contexts.
-    glBindVertexArray(0);
+  // Packed grid coordinates are stored less this, to use the whole signed 10-bit range.
+  static const long PackedOffset = 512;
+
+  GLfloat extent;
+  std::array<float,3> planeColor;
+  MeshGeometry geometry;
+  bool packedPositions;
+  std::array<float,16> positionMatrix;
+  bool initialized = false;
+  GLuint colorBuffer = 0;
+  GLuint vertexBuffer = 0;
+  GLuint indexBuffer = 0;
+  GLuint paletteTexture = 0;
+  std::vector<std::pair<GLFWwindow*, GLuint>> vertexArrays;   // Direct state access only, one per context
+  GLuint uniformProgram = 0;
+  GLint planeColorUniform = -1;
+  GLint quadsPerRowUniform = -1;
+  GLint paletteStrideUniform = -1;
+  GLint lodStepUniform = -1;
+  GLint paletteUniform = -1;
+  LargePageVector<uint8_t> colorBufferData;
+  LargePageVector<GLfloat> vertexBufferData;
+  LargePageVector<uint32_t> packedVertexBufferData;
+  LargePageVector<GLuint> indexBufferData;
+  std::shared_ptr<MeshCacheEntry> cacheEntry;
+  const uint8_t* colorData = nullptr;
+  const GLfloat* vertexData = nullptr;
+  const uint32_t* packedVertexData = nullptr;
+  const GLuint* indexData = nullptr;
+  size_t numVertices = 0;
+  size_t numColors = 0;
+  size_t paletteStride = 0;       // Quads per row at full detail
+  size_t numIndices = 0;
+  std::vector<LodLevel> levels;     // Copied from the cache entry, which is small.
+};
 
-    // Enable the vertex attribute arrays we are going to use
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
+const unsigned MeshPlane::VertexCacheSize;
+const GLuint MeshPlane::RestartIndex;
+bool MeshPlane::directStateAccess = false;
 
-    // Bind the vertex buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+//================================================================================================
+// Offscreen render target with a 32-bit floating-point depth attachment.  The default framebuffer
+// usually only offers a 24-bit fixed-point depth buffer, which throws away most of the precision that
+// reversed-Z gains, so when it is in use we render here and blit the color to the window.
 
-    // Bind the color buffer object
-    glBindBuffer(GL_ARRAY_BUFFER, colorBuffer);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)0);
+class RenderTarget {
+public:
+  RenderTarget(int width, int height) : width(width), height(height) {
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      throw std::runtime_error("Offscreen framebuffer incomplete.");
+    }
+  }
 
-    // Draw our geometry
-    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertexBufferData.size()));
+  ~RenderTarget() {
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteTextures(1, &depthTexture);
   }
 
+  // Direct rendering into this target.
+  void bind() {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, width, height);
+  }
+
+  // Copy the color attachment into the window's back buffer, stretching it if the sizes differ, and
+  // leave the default framebuffer bound with the viewport covering the window.
+  void blitToWindow(int windowWidth, int windowHeight) {
+    glViewport(0, 0, windowWidth, windowHeight);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  }
+
+  int getWidth() const { return width; }
+  int getHeight() const { return height; }
+  GLuint getColorTexture() const { return colorTexture; }
+  GLuint getDepthTexture() const { return depthTexture; }
+
 private:
-  MeshPlane(const MeshPlane&) = delete;
-  MeshPlane& operator=(const MeshPlane&) = delete;
-  bool initialized = false;
-  GLuint colorBuffer = 0;
-  GLuint vertexBuffer = 0;
-  std::vector<GLfloat> colorBufferData;
-  std::vector<GLfloat> vertexBufferData;
+  RenderTarget(const RenderTarget&) = delete;
+  RenderTarget& operator=(const RenderTarget&) = delete;
+  int width;
+  int height;
+  GLuint framebuffer = 0;
+  GLuint colorTexture = 0;
+  GLuint depthTexture = 0;
 };
 
 //================================================================================================
@@ -305,45 +1032,787 @@ void createProjectionMatrix(float fieldOfView, float aspectRatio, float nearPlan
   result[15] = 0.0f;
 }
 
+// Function to create a reversed-Z projection matrix for use with a [0,1] clip-space depth range
+// (glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE)).  The near plane maps to depth 1 and the far plane
+// to depth 0, which pairs the non-linear depth distribution with the higher precision of floating-point
+// values near zero.  Depth testing must use GL_GREATER and depth must be cleared to 0.
+void createReversedZProjectionMatrix(float fieldOfView, float aspectRatio, float nearPlane, float farPlane, float result[16]) {
+  float f = 1.0f / tan(degreesToRadians(fieldOfView) / 2.0f);
+  result[0] = f / aspectRatio;
+  result[1] = 0.0f;
+  result[2] = 0.0f;
+  result[3] = 0.0f;
+  result[4] = 0.0f;
+  result[5] = f;
+  result[6] = 0.0f;
+  result[7] = 0.0f;
+  result[8] = 0.0f;
+  result[9] = 0.0f;
+  result[10] = nearPlane / (farPlane - nearPlane);
+  result[11] = -1.0f;
+  result[12] = 0.0f;
+  result[13] = 0.0f;
+  result[14] = (farPlane * nearPlane) / (farPlane - nearPlane);
+  result[15] = 0.0f;
+}
+
 //================================================================================================
-// Main function to create a window and draw colored geometry.
+// Scene camera shared by the OpenGL and CPU renderers.
+
+// Projection used for the scene: a very wide field of view with near=0.1 and far=100.
+void createSceneProjectionMatrix(int width, int height, bool reversedZ, float result[16]) {
+  float aspect = static_cast<float>(width) / static_cast<float>(height);
+  if (reversedZ) {
+    createReversedZProjectionMatrix(150.0f, aspect, 0.1f, 100.0f, result);
+  } else {
+    createProjectionMatrix(150.0f, aspect, 0.1f, 100.0f, result);
+  }
+}
 
-int main(int argc, char* argv[])
-{
-  // Value of -1 does not use full screen. Setting to 0 or higher selects the display to use.
-  int fullScreenDisplay = -1;
-  int width = 7680;
-  int height = 4320;
-  double fps = 60.0;
+// Construct the view transformation matrix at the specified time in seconds.  To reproduce the tearing,
+// we rotate around the Y axis by around 90 degrees and then we rotate around the X axis periodically by
+// around +/- 10 degrees from 5.
+void createViewMatrix(double seconds, float result[16]) {
+  std::array<float, 16> xrot, yrot;
+  createRotationMatrixY(degreesToRadians(90.0f), yrot.data());
+  float angle = 5 + 10.0f * sin(0.5 * Pi * seconds);
+  createRotationMatrixX(degreesToRadians(angle), xrot.data());
+  multiplyMatrices({yrot.data(), xrot.data()}, result);
+}
 
-  for (int i = 1; i < argc; ++i) {
-    std::string arg = argv[i];
-    if (arg == "--fullScreenDisplay" && i + 1 < argc) {
-      fullScreenDisplay = std::stoi(argv[++i]);
-    } else if (arg == "--width" && i + 1 < argc) {
-      width = std::stoi(argv[++i]);
-    } else if (arg == "--height" && i + 1 < argc) {
-      height = std::stoi(argv[++i]);
-    } else if (arg == "--fps" && i + 1 < argc) {
-      fps = std::stod(argv[++i]);
+//================================================================================================
+// Report how well the vertex cache is used by each level of an indexed plane, against the plain
+// row-by-row order of the same quads.
+
+void reportVertexCacheStats(const MeshPlane& plane, size_t numTriangles) {
+  size_t n = MeshPlane::quadsPerEdge(numTriangles);
+  size_t numVertices = static_cast<size_t>(plane.getNumVertices());
+  std::cout << "Vertex cache (FIFO of " << MeshPlane::VertexCacheSize << "), ACMR/ATVR row order -> optimized:"
+    << std::endl;
+  for (size_t level = 0, step = 1; level < plane.getNumLevels(); level++, step *= 2) {
+    std::vector<GLuint> rowOrder = MeshPlane::gridIndices(n, step);
+    VertexCacheStats before = simulateVertexCache(rowOrder.data(), rowOrder.size(), numVertices,
+      MeshPlane::VertexCacheSize);
+    VertexCacheStats after = simulateVertexCache(plane.getIndexData(level), plane.getNumTriangles(level) * 3,
+      numVertices, MeshPlane::VertexCacheSize);
+    std::cout << "  Level " << level << ": " << after.triangles << " triangles, " << before.acmr() << "/"
+      << before.atvr() << " -> " << after.acmr() << "/" << after.atvr() << std::endl;
+  }
+}
+
+//================================================================================================
+// Benchmark of the ways of drawing the planes.  Each geometry, with float and then packed positions, is
+// drawn at full detail from a fixed view for the given number of frames, with the GPU time of the plane
+// draws measured by a timer query, so that the cost of the vertex work can be compared.  Large
+// --trianglesPerPlane values on a small window make the comparison vertex-bound.
+
+void runGeometryBenchmark(size_t frames,
+  const std::function<std::vector< std::shared_ptr<MeshPlane> >(MeshGeometry, bool)>& makePlanes,
+  const std::vector< std::array<float, 16> >& transforms, const std::array<float, 16>& projection,
+  RenderTarget* renderTarget, bool reversedZ) {
+  struct Case {
+    MeshGeometry geometry;
+    const char* name;
+    const GLchar* vertexShader;
+    const GLchar* fragmentShader;
+  };
+  const Case cases[] = {
+    { MeshGeometry::List, "list", PaletteVertexShader, PaletteFragmentShader },
+    { MeshGeometry::Indexed, "indexed", VertexShader, FragmentShader },
+    { MeshGeometry::Strips, "strips", PaletteVertexShader, PaletteFragmentShader }
+  };
+
+  std::array<float, 16> view, sceneProjection = projection;
+  createViewMatrix(0.0, view.data());
+  std::vector<GLuint> queries(frames);
+  glGenQueries(static_cast<GLsizei>(frames), queries.data());
+
+  std::cout << "Benchmark of " << frames << " frames per geometry:" << std::endl;
+  for (const Case& c : cases) for (int packed = 0; packed < 2; packed++) {
+    std::vector< std::shared_ptr<MeshPlane> > planes = makePlanes(c.geometry, packed != 0);
+    if (packed && !planes[0]->hasPackedPositions()) { continue; }
+    GLuint program = buildProgram(c.vertexShader, c.fragmentShader, "Plane");
+    glUseProgram(program);
+    GLint mvpUniform = glGetUniformLocation(program, "modelViewProjection");
+
+    size_t triangles = 0, indices = 0, vertices = 0, positionBytes = 0;
+    for (auto const& plane : planes) {
+      triangles += plane->getNumTriangles();
+      indices += plane->getNumIndices();
+      vertices += static_cast<size_t>(plane->getNumVertices());
+      positionBytes += plane->getPositionBytes();
+    }
+
+    // One untimed frame uploads the buffers.
+    for (size_t f = 0; f <= frames; f++) {
+      if (renderTarget) {
+        renderTarget->bind();
+      }
+      glClearDepth(reversedZ ? 0.0 : 1.0);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+      if (f > 0) {
+        glBeginQuery(GL_TIME_ELAPSED, queries[f - 1]);
+      }
+      std::array<float, 16> modelViewProjection, drawMatrix;
+      for (size_t p = 0; p < planes.size(); p++) {
+        std::array<float, 16> model = transforms[p];
+        multiplyMatrices({ model.data(), view.data(), sceneProjection.data() }, modelViewProjection.data());
+        planes[p]->applyPositionMatrix(modelViewProjection.data(), drawMatrix.data());
+        glUniformMatrix4fv(mvpUniform, 1, GL_FALSE, drawMatrix.data());
+        planes[p]->draw();
+      }
+      if (f > 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+      }
+      glFinish();
+    }
+
+    double total = 0, fastest = 0;
+    for (size_t f = 0; f < frames; f++) {
+      GLuint64 ns = 0;
+      glGetQueryObjectui64v(queries[f], GL_QUERY_RESULT, &ns);
+      double ms = ns * 1e-6;
+      total += ms;
+      if (f == 0 || ms < fastest) { fastest = ms; }
+    }
+    double mean = total / frames;
+    std::cout << "  " << c.name << (packed ? " packed" : " float") << ": " << mean << " ms mean, "
+      << fastest << " ms fastest, " << triangles / (mean * 1e3) << " Mtriangles/s; " << triangles
+      << " triangles, " << vertices << " vertices (" << positionBytes / 1048576.0 << " MB of positions), "
+      << indices << " indices" << std::endl;
+
+    planes.clear();
+    glDeleteProgram(program);
+  }
+  glDeleteQueries(static_cast<GLsizei>(frames), queries.data());
+}
+
+//================================================================================================
+// Frame capture and golden-image comparison.
+
+// Read back the currently bound framebuffer, flipping it so the top row comes first.
+Image captureFramebuffer(int width, int height) {
+  Image image(width, height);
+  LargePageVector<uint8_t> pixels(image.pixels.size());
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+  size_t rowBytes = static_cast<size_t>(width) * 4;
+  for (int y = 0; y < height; y++) {
+    std::copy(pixels.begin() + (height - 1 - y) * rowBytes, pixels.begin() + (height - y) * rowBytes, image.row(y));
+  }
+  return image;
+}
+
+// Write the image and/or compare it with a golden image, reporting the differences.  Returns 0 on
+// success, 6 on a file error and 7 if the image does not match the golden image.
+int checkCapturedImage(const Image& image, const std::string& captureFile, const std::string& goldenFile,
+  const std::array<int, 3>& tolerance, unsigned numThreads)
+{
+  try {
+    if (!captureFile.empty()) {
+      writePPM(captureFile, image);
+      std::cout << "Wrote " << captureFile << std::endl;
+    }
+    if (goldenFile.empty()) {
+      return 0;
+    }
+    Image golden = readPPM(goldenFile);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ImageComparison result = compareImages(image, golden, tolerance, numThreads);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if (!result.sizesMatch) {
+      std::cerr << "Golden image " << goldenFile << " is " << golden.width << "x" << golden.height
+        << " but the frame is " << image.width << "x" << image.height << std::endl;
+      return 7;
+    }
+    std::cout << "Comparison with " << goldenFile << " (" << elapsed.count() * 1e3 << " ms):" << std::endl;
+    std::cout << "  Max error (R,G,B): " << result.maxError[0] << ", " << result.maxError[1] << ", "
+      << result.maxError[2] << std::endl;
+    std::cout << "  Mean error (R,G,B): " << result.meanError[0] << ", " << result.meanError[1] << ", "
+      << result.meanError[2] << std::endl;
+    std::cout << "  Differing pixels: " << result.differingPixels << " of " << result.totalPixels << std::endl;
+    return result.differingPixels == 0 ? 0 : 7;
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 6;
+  }
+}
+
+//================================================================================================
+// CPU reference rendering of the scene, which needs no OpenGL context.  It renders the view at the
+// specified time the requested number of times to measure throughput, then writes the last frame to a
+// PPM file and/or compares it with a golden image.
+
+int renderCpuReference(const std::vector< std::shared_ptr<MeshPlane> >& planes,
+  const std::vector< std::array<float, 16> >& transforms, int width, int height, bool reversedZ,
+  unsigned numThreads, size_t numFrames, double seconds, const std::string& fileName,
+  const std::string& goldenFile, const std::array<int, 3>& tolerance)
+{
+  std::array<float, 16> projection, view;
+  createSceneProjectionMatrix(width, height, reversedZ, projection.data());
+  createViewMatrix(seconds, view.data());
+
+  SoftwareRasterizer rasterizer(width, height, numThreads);
+  rasterizer.setReversedZ(reversedZ);
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t f = 0; f < numFrames; f++) {
+    rasterizer.clear({0.6f, 0.8f, 1.0f});
+    std::array<float, 16> modelViewProjection;
+    for (size_t p = 0; p < planes.size(); p++) {
+      std::array<float, 16> model = transforms[p];
+      multiplyMatrices({ model.data(), view.data(), projection.data()}, modelViewProjection.data());
+      // Two triangles per quad, each quad with one brightness.
+      rasterizer.drawFlatTriangles(planes[p]->getVertexData(), planes[p]->getNumVertices(),
+        planes[p]->getBrightnessData(), 2, planes[p]->getColor(), modelViewProjection.data());
+    }
+    rasterizer.finish();
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  double perFrame = elapsed.count() / numFrames;
+  std::cout << "CPU reference: " << numFrames << " frames at " << width << "x" << height << std::endl;
+  std::cout << "  Time per frame: " << perFrame * 1e3 << " ms (" << 1.0 / perFrame << " fps)" << std::endl;
+  std::cout << "  Triangles per frame: " << rasterizer.getTrianglesSubmitted() << " submitted, "
+    << rasterizer.getTrianglesRasterized() << " after clipping" << std::endl;
+  std::cout << "  Throughput: " << rasterizer.getTrianglesSubmitted() / perFrame / 1e6 << " Mtriangles/s, "
+    << static_cast<double>(width) * height / perFrame / 1e6 << " Mpixels/s" << std::endl;
+
+  return checkCapturedImage(rasterizer.getImage(), fileName, goldenFile, tolerance, numThreads);
+}
+
+//================================================================================================
+// Monitors and their video modes.
+
+// Size, refresh rate and color depth of a video mode, e.g. "7680x4320 at 60 Hz, 24 bits (8/8/8)".
+std::string describeVideoMode(const GLFWvidmode& mode) {
+  return std::to_string(mode.width) + "x" + std::to_string(mode.height) + " at " + std::to_string(mode.refreshRate) +
+    " Hz, " + std::to_string(mode.redBits + mode.greenBits + mode.blueBits) + " bits (" +
+    std::to_string(mode.redBits) + "/" + std::to_string(mode.greenBits) + "/" + std::to_string(mode.blueBits) + ")";
+}
+
+// Print each monitor with its current video mode and the modes it supports.
+void listVideoModes() {
+  int count = 0;
+  GLFWmonitor** monitors = glfwGetMonitors(&count);
+  if (count == 0 || !monitors) {
+    std::cout << "No monitors found" << std::endl;
+    return;
+  }
+  for (int m = 0; m < count; m++) {
+    int widthMM = 0, heightMM = 0;
+    glfwGetMonitorPhysicalSize(monitors[m], &widthMM, &heightMM);
+    const char* name = glfwGetMonitorName(monitors[m]);
+    std::cout << "Monitor " << m << ": " << (name ? name : "(unnamed)") << ", " << widthMM << "x" << heightMM << " mm"
+      << (monitors[m] == glfwGetPrimaryMonitor() ? ", primary" : "") << std::endl;
+    const GLFWvidmode* current = glfwGetVideoMode(monitors[m]);
+    if (current) {
+      std::cout << "  Current: " << describeVideoMode(*current) << std::endl;
+    }
+    int numModes = 0;
+    const GLFWvidmode* modes = glfwGetVideoModes(monitors[m], &numModes);
+    for (int i = 0; i < numModes; i++) {
+      std::cout << "  " << describeVideoMode(modes[i]) << std::endl;
+    }
+  }
+}
+
+// The monitor's mode of the specified size with the highest refresh rate, and of those the greatest
+// color depth, or nullptr if it has no mode of that size.
+const GLFWvidmode* findFastestVideoMode(GLFWmonitor* monitor, int width, int height) {
+  int numModes = 0;
+  const GLFWvidmode* modes = glfwGetVideoModes(monitor, &numModes);
+  const GLFWvidmode* best = nullptr;
+  for (int i = 0; i < numModes; i++) {
+    const GLFWvidmode& mode = modes[i];
+    if (mode.width != width || mode.height != height) {
+      continue;
+    }
+    if (!best || mode.refreshRate > best->refreshRate || (mode.refreshRate == best->refreshRate &&
+        mode.redBits + mode.greenBits + mode.blueBits > best->redBits + best->greenBits + best->blueBits)) {
+      best = &mode;
+    }
+  }
+  return best;
+}
+
+//================================================================================================
+// Window resizing.  GLFW reports the new framebuffer size from inside glfwPollEvents(), once per
+// step of an interactive resize, so the callback only records it and the main loop acts on it
+// between frames.
+
+// Time without further size changes after which a resize is taken to be over and the offscreen
+// targets are reallocated at the new size.
+static const std::chrono::milliseconds ResizeSettleTime(100);
+
+static struct FramebufferResize {
+  bool pending = false;
+  int width = 0;
+  int height = 0;
+  std::chrono::steady_clock::time_point time;   // Of the latest size change
+} framebufferResize;
+
+static void framebufferSizeCallback(GLFWwindow*, int width, int height) {
+  // Minimized windows report a size of zero, which there is nothing to render at.
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+  framebufferResize.pending = true;
+  framebufferResize.width = width;
+  framebufferResize.height = height;
+  framebufferResize.time = std::chrono::steady_clock::now();
+}
+
+//================================================================================================
+// Main function to create a window and draw colored geometry.
+
+int main(int argc, char* argv[])
+{
+  // Value of -1 does not use full screen. Setting to 0 or higher selects the display to use.
+  int fullScreenDisplay = -1;
+  int width = 7680;
+  int height = 4320;
+  double fps = 60.0;
+  bool fpsSet = false;
+  bool listModes = false;
+  bool reversedZ = false;
+  std::string cpuReferenceFile;
+  size_t cpuFrames = 1;
+  unsigned cpuThreads = 0;
+  double fixedTime = -1.0;
+  std::string captureFile;
+  size_t captureFrame = 10;
+  std::string goldenFile;
+  std::array<int, 3> tolerance = {{0, 0, 0}};
+  bool useRowChecksums = false;
+  bool debugContext = false;
+  std::string vertexShaderFile;
+  std::string fragmentShaderFile;
+  std::string meshCacheDirectory;
+  size_t trianglesPerPlane = 0;
+  MeshGeometry geometry = MeshGeometry::List;
+  bool useLod = false;
+  float lodPixelsPerTriangle = 16.0f;
+  bool cacheStats = false;
+  size_t benchmarkFrames = 0;
+  bool packedPositions = false;
+  bool noDirectStateAccess = false;
+  bool useGpuCulling = false;
+  bool useHiZ = false;
+  bool useOcclusionQueries = false;
+  size_t planeCount = 0;
+  std::string recordFile;
+  size_t recordFrames = 60;
+  bool useHud = false;
+  int cpuCore = -1;
+  bool realTime = false;
+  SchedulingPolicy realTimePolicy = SchedulingPolicy::Fifo;
+  int realTimePriority = 50;
+  bool lockMemory = false;
+  bool contextSwitches = false;
+  std::string contextSwitchLog;
+  LargePageMode largePages = LargePageMode::Off;
+  bool numaBind = false;
+  bool swapIntervalSet = false;
+  int swapInterval = 1;
+  bool useLatencyProbe = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--fullScreenDisplay" && i + 1 < argc) {
+      fullScreenDisplay = std::stoi(argv[++i]);
+    } else if (arg == "--width" && i + 1 < argc) {
+      width = std::stoi(argv[++i]);
+    } else if (arg == "--height" && i + 1 < argc) {
+      height = std::stoi(argv[++i]);
+    } else if (arg == "--fps" && i + 1 < argc) {
+      fps = std::stod(argv[++i]);
+      fpsSet = true;
+    } else if (arg == "--listModes") {
+      listModes = true;
+    } else if (arg == "--reversedZ") {
+      reversedZ = true;
+    } else if (arg == "--cpuReference" && i + 1 < argc) {
+      cpuReferenceFile = argv[++i];
+    } else if (arg == "--cpuFrames" && i + 1 < argc) {
+      cpuFrames = std::stoul(argv[++i]);
+      if (cpuFrames < 1) { cpuFrames = 1; }
+    } else if (arg == "--threads" && i + 1 < argc) {
+      cpuThreads = static_cast<unsigned>(std::stoul(argv[++i]));
+    } else if (arg == "--fixedTime" && i + 1 < argc) {
+      fixedTime = std::stod(argv[++i]);
+    } else if (arg == "--capture" && i + 1 < argc) {
+      captureFile = argv[++i];
+    } else if (arg == "--captureFrame" && i + 1 < argc) {
+      captureFrame = std::stoul(argv[++i]);
+      if (captureFrame < 1) { captureFrame = 1; }
+    } else if (arg == "--golden" && i + 1 < argc) {
+      goldenFile = argv[++i];
+    } else if (arg == "--tolerance" && i + 1 < argc) {
+      // Either one value for all channels or R,G,B.
+      std::string value = argv[++i];
+      size_t c1 = value.find(',');
+      if (c1 == std::string::npos) {
+        tolerance.fill(std::stoi(value));
+      } else {
+        size_t c2 = value.find(',', c1 + 1);
+        tolerance[0] = std::stoi(value.substr(0, c1));
+        tolerance[1] = std::stoi(value.substr(c1 + 1, c2 - c1 - 1));
+        tolerance[2] = c2 == std::string::npos ? tolerance[1] : std::stoi(value.substr(c2 + 1));
+      }
+    } else if (arg == "--rowChecksums") {
+      useRowChecksums = true;
+    } else if (arg == "--debugContext") {
+      debugContext = true;
+    } else if (arg == "--vertexShader" && i + 1 < argc) {
+      vertexShaderFile = argv[++i];
+    } else if (arg == "--fragmentShader" && i + 1 < argc) {
+      fragmentShaderFile = argv[++i];
+    } else if (arg == "--meshCache" && i + 1 < argc) {
+      meshCacheDirectory = argv[++i];
+    } else if (arg == "--trianglesPerPlane" && i + 1 < argc) {
+      trianglesPerPlane = std::stoul(argv[++i]);
+    } else if (arg == "--geometry" && i + 1 < argc) {
+      std::string value = argv[++i];
+      if (value == "list") {
+        geometry = MeshGeometry::List;
+      } else if (value == "indexed") {
+        geometry = MeshGeometry::Indexed;
+      } else if (value == "strips") {
+        geometry = MeshGeometry::Strips;
+      } else {
+        std::cerr << "Unknown geometry: " << value << std::endl;
+        return 1;
+      }
+    } else if (arg == "--lod") {
+      useLod = true;
+    } else if (arg == "--lodPixelsPerTriangle" && i + 1 < argc) {
+      lodPixelsPerTriangle = std::stof(argv[++i]);
+      if (lodPixelsPerTriangle <= 0) { lodPixelsPerTriangle = 1; }
+    } else if (arg == "--cacheStats") {
+      cacheStats = true;
+    } else if (arg == "--benchmark" && i + 1 < argc) {
+      benchmarkFrames = std::stoul(argv[++i]);
+    } else if (arg == "--packedPositions") {
+      packedPositions = true;
+    } else if (arg == "--noDirectStateAccess") {
+      noDirectStateAccess = true;
+    } else if (arg == "--gpuCulling") {
+      useGpuCulling = true;
+    } else if (arg == "--hiZ") {
+      useGpuCulling = true;
+      useHiZ = true;
+    } else if (arg == "--occlusionQueries") {
+      useOcclusionQueries = true;
+    } else if (arg == "--planeCount" && i + 1 < argc) {
+      planeCount = std::stoul(argv[++i]);
+    } else if (arg == "--record" && i + 1 < argc) {
+      recordFile = argv[++i];
+    } else if (arg == "--recordFrames" && i + 1 < argc) {
+      recordFrames = std::stoul(argv[++i]);
+      if (recordFrames < 1) { recordFrames = 1; }
+    } else if (arg == "--hud") {
+      useHud = true;
+    } else if (arg == "--cpuCore" && i + 1 < argc) {
+      cpuCore = std::stoi(argv[++i]);
+    } else if (arg == "--realTime" && i + 1 < argc) {
+      std::string value = argv[++i];
+      if (value == "fifo") {
+        realTimePolicy = SchedulingPolicy::Fifo;
+      } else if (value == "rr") {
+        realTimePolicy = SchedulingPolicy::RoundRobin;
+      } else {
+        std::cerr << "Unknown real-time policy: " << value << std::endl;
+        return 1;
+      }
+      realTime = true;
+    } else if (arg == "--realTimePriority" && i + 1 < argc) {
+      realTimePriority = std::stoi(argv[++i]);
+    } else if (arg == "--lockMemory") {
+      lockMemory = true;
+    } else if (arg == "--contextSwitches") {
+      contextSwitches = true;
+    } else if (arg == "--contextSwitchLog" && i + 1 < argc) {
+      contextSwitchLog = argv[++i];
+      contextSwitches = true;
+    } else if (arg == "--largePages" && i + 1 < argc) {
+      std::string value = argv[++i];
+      if (value == "off") {
+        largePages = LargePageMode::Off;
+      } else if (value == "transparent") {
+        largePages = LargePageMode::Transparent;
+      } else if (value == "explicit") {
+        largePages = LargePageMode::Explicit;
+      } else {
+        std::cerr << "Unknown large page mode: " << value << std::endl;
+        return 1;
+      }
+    } else if (arg == "--numaBind") {
+      numaBind = true;
+    } else if (arg == "--swapInterval" && i + 1 < argc) {
+      swapInterval = std::stoi(argv[++i]);
+      swapIntervalSet = true;
+    } else if (arg == "--latencyProbe") {
+      useLatencyProbe = true;
     } else {
       std::cerr << "Unknown argument: " << arg << std::endl;
-      std::cerr << "Usage: " << argv[0] << " [--fullScreenDisplay <index>] [--width <width>] [--height <height>] [--fps <fps>]" << std::endl;
+      std::cerr << "Usage: " << argv[0] << " [--fullScreenDisplay <index>] [--width <width>] [--height <height>] [--fps <fps>] [--listModes] [--reversedZ]"
+        << " [--cpuReference <file.ppm>] [--cpuFrames <count>] [--threads <count>]"
+        << " [--fixedTime <seconds>] [--capture <file.ppm>] [--captureFrame <n>] [--golden <file.ppm>]"
+        << " [--tolerance <t>|<r,g,b>] [--rowChecksums] [--debugContext]"
+        << " [--vertexShader <file>] [--fragmentShader <file>] [--meshCache <directory>]"
+        << " [--trianglesPerPlane <count>] [--geometry list|indexed|strips] [--lod] [--lodPixelsPerTriangle <pixels>]"
+        << " [--cacheStats] [--benchmark <frames>] [--packedPositions] [--noDirectStateAccess]"
+        << " [--gpuCulling] [--hiZ] [--occlusionQueries] [--planeCount <count>]"
+        << " [--record <file>] [--recordFrames <n>] [--hud]"
+        << " [--cpuCore <core>] [--realTime fifo|rr] [--realTimePriority <priority>] [--lockMemory]"
+        << " [--contextSwitches] [--contextSwitchLog <file.csv>] [--largePages off|transparent|explicit]"
+        << " [--numaBind] [--swapInterval <n>] [--latencyProbe]" << std::endl;
       std::cerr << "  --fullScreenDisplay <index>  Index of the full screen display to use (default -1 disables)" << std::endl;
       std::cerr << "  --width <width>              Width of the window (default 7680)" << std::endl;
       std::cerr << "  --height <height>            Height of the window (default 4320)" << std::endl;
-      std::cerr << "  --fps <fps>                  Frames per second (default 60.0)" << std::endl;
+      std::cerr << "  --fps <fps>                  Frames per second (default 60.0, or the fastest mode full screen)" << std::endl;
+      std::cerr << "  --listModes                  List the monitors and their video modes and exit" << std::endl;
+      std::cerr << "  --reversedZ                  Render with reversed-Z into a 32-bit float depth buffer" << std::endl;
+      std::cerr << "  --cpuReference <file.ppm>    Render on the CPU without a window and write the image" << std::endl;
+      std::cerr << "  --cpuFrames <count>          Frames to render with --cpuReference for timing (default 1)" << std::endl;
+      std::cerr << "  --threads <count>            CPU rendering threads (default one per hardware thread)" << std::endl;
+      std::cerr << "  --fixedTime <seconds>        Freeze the animation at this time so frames are repeatable" << std::endl;
+      std::cerr << "  --capture <file.ppm>         Write frame --captureFrame to a file and exit" << std::endl;
+      std::cerr << "  --captureFrame <n>           Frame number to capture (default 10)" << std::endl;
+      std::cerr << "  --golden <file.ppm>          Compare the captured frame with a golden image and exit" << std::endl;
+      std::cerr << "  --tolerance <t>|<r,g,b>      Per-channel tolerance for the golden comparison (default 0)" << std::endl;
+      std::cerr << "  --rowChecksums               Hash each row on the GPU and check frame-to-frame consistency" << std::endl;
+      std::cerr << "  --debugContext               Use a debug context and report driver messages at exit" << std::endl;
+      std::cerr << "  --vertexShader <file>        Load the vertex shader from a file and reload it when it changes" << std::endl;
+      std::cerr << "  --fragmentShader <file>      Load the fragment shader from a file and reload it when it changes" << std::endl;
+      std::cerr << "  --meshCache <directory>      Map generated meshes from (and save them to) a cache directory" << std::endl;
+      std::cerr << "  --trianglesPerPlane <count>  Triangles in each plane (default 1200)" << std::endl;
+      std::cerr << "  --geometry list|indexed|strips  Triangle list, indexed grid or strips with restarts (default list)" << std::endl;
+      std::cerr << "  --lod                        Pick each plane's level of detail from its screen area (not with list)" << std::endl;
+      std::cerr << "  --lodPixelsPerTriangle <p>   Screen pixels per triangle that --lod aims for (default 16)" << std::endl;
+      std::cerr << "  --cacheStats                 Report simulated vertex cache use of the indexed geometry" << std::endl;
+      std::cerr << "  --benchmark <frames>         Time the plane draws on the GPU for each geometry and exit" << std::endl;
+      std::cerr << "  --packedPositions            Store positions as packed 10-bit integers instead of floats" << std::endl;
+      std::cerr << "  --noDirectStateAccess        Set up buffers by binding them even when direct state access is available" << std::endl;
+      std::cerr << "  --gpuCulling                 Frustum cull instances of one plane on the GPU and draw them indirectly" << std::endl;
+      std::cerr << "  --hiZ                        Also cull planes hidden behind the previous frame's depth (implies --gpuCulling)" << std::endl;
+      std::cerr << "  --occlusionQueries           Skip planes whose box was hidden in the previous frame" << std::endl;
+      std::cerr << "  --planeCount <count>         Number of planes, laid out over the same angles (default 21)" << std::endl;
+      std::cerr << "  --record <file>              Record the GL calls of setup and --recordFrames frames for GLReplay" << std::endl;
+      std::cerr << "  --recordFrames <n>           Frames to record before exiting (default 60)" << std::endl;
+      std::cerr << "  --hud                        Overlay a graph of frame times, the frame rate, torn frames and missed vblanks" << std::endl;
+      std::cerr << "  --cpuCore <core>             Run the render thread only on this logical CPU" << std::endl;
+      std::cerr << "  --realTime fifo|rr           Give the render thread SCHED_FIFO or SCHED_RR scheduling" << std::endl;
+      std::cerr << "  --realTimePriority <p>       Real-time priority, 1-99 (default 50)" << std::endl;
+      std::cerr << "  --lockMemory                 Lock all of the process's memory with mlockall" << std::endl;
+      std::cerr << "  --contextSwitches            Count the render thread's involuntary context switches per frame" << std::endl;
+      std::cerr << "  --contextSwitchLog <file>    Also write each frame's interval and context switches as CSV" << std::endl;
+      std::cerr << "  --largePages off|transparent|explicit  Huge pages for mesh and capture arrays (default off)" << std::endl;
+      std::cerr << "  --numaBind                   Place mesh and capture arrays on the render thread's NUMA node" << std::endl;
+      std::cerr << "  --swapInterval <n>           Vblanks per swap: 1 vsync, 0 immediate, -1 adaptive (default driver's)" << std::endl;
+      std::cerr << "  --latencyProbe               Measure key/mouse press to present latency; P cycles the pacing mode" << std::endl;
       return 1;
     }
   }
 
+  if (listModes) {
+    glfwInit();
+    listVideoModes();
+    glfwTerminate();
+    return 0;
+  }
+
   std::cout << "FullScreen display (-1 for none): " << fullScreenDisplay << std::endl;
 
+  // Levels of detail are index ranges, so they need indexed geometry.  The CPU reference renderer
+  // only draws triangle lists at full detail.
+  if (useLod && geometry == MeshGeometry::List) {
+    geometry = MeshGeometry::Indexed;
+  }
+  if (!cpuReferenceFile.empty()) {
+    geometry = MeshGeometry::List;
+    useLod = false;
+    packedPositions = false;
+    useGpuCulling = false;
+  }
+  // GPU culling draws every visible instance with one command, so they all get the full tessellation.
+  if (useGpuCulling && useLod) {
+    std::cerr << "--lod is not used with --gpuCulling" << std::endl;
+    useLod = false;
+  }
+  if (useGpuCulling && useOcclusionQueries) {
+    std::cerr << "--occlusionQueries is not used with --gpuCulling" << std::endl;
+    useOcclusionQueries = false;
+  }
+  // Only the calls made in this file are recorded, so a recording leaves out the features whose GL
+  // work happens elsewhere; a replay without them would not draw the same frames.
+  if (!recordFile.empty()) {
+    if (benchmarkFrames > 0) {
+      std::cerr << "--record is not used with --benchmark" << std::endl;
+      recordFile.clear();
+    } else if (useGpuCulling || useOcclusionQueries || useRowChecksums || useHud || useLatencyProbe) {
+      std::cerr << "--gpuCulling, --occlusionQueries, --rowChecksums, --hud and --latencyProbe are not used with --record"
+        << std::endl;
+      useGpuCulling = false;
+      useHiZ = false;
+      useOcclusionQueries = false;
+      useRowChecksums = false;
+      useHud = false;
+      useLatencyProbe = false;
+    }
+  }
+
+  //================================================================================================
+  // Make our geometry objects, which will know how to draw themselves.  There will be 21 of them with
+  // colors chosen from a set of 6. They will each be translated and then rotated around the Y and X axes
+  // by different amounts, so we construct combined model transform matrices for each.  A different
+  // --planeCount spreads that many smaller planes over the same angles.  With GPU culling they are all
+  // instances of one plane.
+  float radius = 5.0f;
+  size_t quadsPerEdge = 10;
+  size_t trianglesPerSide = 2 * quadsPerEdge * quadsPerEdge;
+  // 6 faces
+  size_t numTriangles = static_cast<size_t>(trianglesPerSide * 6);
+  if (trianglesPerPlane > 0) {
+    numTriangles = trianglesPerPlane;
+  }
+  if (packedPositions && !MeshPlane::canPackPositions(numTriangles)) {
+    std::cerr << "Too many triangles per plane for packed positions, using floats" << std::endl;
+    packedPositions = false;
+  }
+  std::vector< std::array<float, 3> > colors = {
+    {1.0f, 0.5f, 0.5f},
+    {0.5f, 1.0f, 0.5f},
+    {0.5f, 0.5f, 1.0f},
+    {1.0f, 1.0f, 0.5f},
+    {0.5f, 1.0f, 1.0f},
+    {1.0f, 0.5f, 1.0f}
+  };
+  std::vector< std::array<float, 16> > transforms;
+  std::vector< std::array<float, 3> > planeColors;
+  unsigned NX = 7;
+  unsigned NY = 3;
+  float rotX = 30.0f;
+  float rotY = 30.0f;
+  float planeScale = radius;
+  if (planeCount > 0 && planeCount != NX * NY) {
+    unsigned nx = std::max(1u, static_cast<unsigned>(std::lround(std::sqrt(planeCount * 7.0 / 3.0))));
+    unsigned ny = static_cast<unsigned>((planeCount + nx - 1) / nx);
+    rotX *= 7.0f / nx;
+    rotY *= 3.0f / ny;
+    planeScale = radius * std::min(7.0f / nx, 3.0f / ny);
+    NX = nx;
+    NY = ny;
+  }
+  size_t numPlanes = planeCount > 0 ? planeCount : NX * NY;
+  auto makePlanes = [&](MeshGeometry planeGeometry, bool planePackedPositions) {
+    std::vector< std::shared_ptr<MeshPlane> > result;
+    for (unsigned i = 0; i < NX; i++) {
+      for (unsigned j = 0; j < NY && result.size() < numPlanes; j++) {
+        result.push_back(std::shared_ptr<MeshPlane>(
+          new MeshPlane(planeScale, numTriangles, colors[(i + j) % colors.size()],
+            static_cast<unsigned>(result.size()), planeGeometry, planePackedPositions, meshCacheDirectory)));
+      }
+    }
+    return result;
+  };
+  // Put the planes' arrays in huge pages and on the render thread's NUMA node if asked.  The render
+  // thread is this one, running on the core it will be pinned to if there is one.
+  int numaNode = -1;
+  if (numaBind) {
+    numaNode = numaNodeOfCpu(cpuCore);
+    if (numaNode < 0) {
+      std::cerr << "Could not find the render thread's NUMA node, memory will not be bound" << std::endl;
+    }
+  }
+  configureLargePages(largePages, numaNode);
+  PageFaults meshFaultsStart = readPageFaults();
+  std::chrono::steady_clock::time_point meshStart = std::chrono::steady_clock::now();
+  std::vector< std::shared_ptr<MeshPlane> > planes;
+  if (useGpuCulling) {
+    planes.push_back(std::shared_ptr<MeshPlane>(new MeshPlane(planeScale, numTriangles, {{1, 1, 1}}, 0,
+      geometry, packedPositions, meshCacheDirectory)));
+  } else {
+    planes = makePlanes(geometry, packedPositions);
+  }
+  for (unsigned i = 0; i < NX; i++) {
+    for (unsigned j = 0; j < NY && transforms.size() < numPlanes; j++) {
+      // Translate in Z so that we can see the planes.
+      std::array<float, 16> translation;
+      createTranslationMatrix(0.0f, 0.0f, -2.0f * radius, translation.data());
+
+      // Rotate around Y first, then X.
+      std::array<float, 16> rotationX;
+      createRotationMatrixY(degreesToRadians(rotX * (i - (NX-1)/2.0f)), rotationX.data());
+      std::array<float, 16> rotationY;
+      createRotationMatrixX(degreesToRadians(rotY * (j - (NY-1)/2.0f)), rotationY.data());
+      std::array<float, 16> xform;
+      multiplyMatrices({translation.data(), rotationY.data(), rotationX.data()}, xform.data());
+      transforms.push_back(xform);
+      planeColors.push_back(colors[(i + j) % colors.size()]);
+    }
+  }
+  std::chrono::duration<double> meshElapsed = std::chrono::steady_clock::now() - meshStart;
+  size_t cachedPlanes = 0;
+  for (auto const& plane : planes) {
+    if (plane->isFromCache()) { cachedPlanes++; }
+  }
+  std::cout << "Built " << planes.size() << " planes of " << numTriangles << " triangles in "
+    << meshElapsed.count() * 1e3 << " ms";
+  if (!meshCacheDirectory.empty()) {
+    std::cout << " (" << cachedPlanes << " mapped from the cache)";
+  }
+  if (useGpuCulling) {
+    std::cout << " for " << numPlanes << " instances";
+  }
+  std::cout << std::endl;
+  PageFaults meshFaults = readPageFaults();
+  std::cout << "Page faults building the planes: " << meshFaults.minor - meshFaultsStart.minor << " minor, "
+    << meshFaults.major - meshFaultsStart.major << " major" << std::endl;
+  if (largePages != LargePageMode::Off || numaNode >= 0) {
+    LargePageStats pageStats = getLargePageStats();
+    std::cout << "Large arrays: " << pageStats.explicitBytes / 1e6 << " MB in explicit huge pages, "
+      << pageStats.transparentBytes / 1e6 << " MB advised for transparent huge pages, "
+      << pageStats.mappedBytes / 1e6 << " MB in normal pages";
+    if (numaNode >= 0) {
+      std::cout << ", preferring NUMA node " << numaNode;
+    }
+    std::cout << std::endl;
+    if (pageStats.explicitFailures > 0) {
+      std::cerr << pageStats.explicitFailures << " arrays did not fit in the reserved huge pages (see vm.nr_hugepages)"
+        << " and were advised for transparent huge pages instead" << std::endl;
+    }
+    if (pageStats.bindFailures > 0) {
+      std::cerr << pageStats.bindFailures << " arrays could not be bound to NUMA node " << numaNode << std::endl;
+    }
+  }
+  // The statistics are for indexed geometry, so build an indexed copy of the first plane if needed.
+  if (cacheStats) {
+    if (geometry == MeshGeometry::Indexed) {
+      reportVertexCacheStats(*planes[0], numTriangles);
+    } else {
+      MeshPlane indexed(planeScale, numTriangles, colors[0], 0, MeshGeometry::Indexed, false, meshCacheDirectory);
+      reportVertexCacheStats(indexed, numTriangles);
+    }
+  }
+
+  // Render on the CPU instead of opening a window if we've been asked to.
+  if (!cpuReferenceFile.empty()) {
+    return renderCpuReference(planes, transforms, width, height, reversedZ, cpuThreads, cpuFrames,
+      fixedTime >= 0 ? fixedTime : 0.0, cpuReferenceFile, goldenFile, tolerance);
+  }
+
   glfwInit();
 
   // Tell it not to iconify full-screen windows that lose focus.
   glfwWindowHint(GLFW_AUTO_ICONIFY, GLFW_FALSE);
 
+  // Ask for a debug context if we're going to log driver messages.
+  if (debugContext) {
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+  }
+
   // Create a windowed mode window and its OpenGL context.
   // This must be done in the same thread that will do the rendering so that the window events will
   // be handled properly on all architectures.
@@ -360,6 +1829,10 @@ int main(int argc, char* argv[])
     return 2;
   }
 
+  // Where the window goes when it leaves full screen.
+  int windowedX = 0, windowedY = 0, windowedWidth = width, windowedHeight = height;
+  glfwGetWindowPos(m_window, &windowedX, &windowedY);
+
   // Determine the full-screen monitor to use, if any.
   GLFWmonitor* fullScreenMonitor = nullptr;
   if (fullScreenDisplay >= 0) {
@@ -376,9 +1849,33 @@ int main(int argc, char* argv[])
     fullScreenMonitor = monitors[fullScreenDisplay];
   }
 
-  // If we're displaying full-screen engage that here along with specifying the refresh rate.
+  // Refresh rate that frames are measured against when the window is not full screen.
+  const double windowedFps = fps;
+
+  // If we're displaying full-screen engage that here along with specifying the refresh rate.  Unless
+  // --fps asks for a rate, use the fastest the monitor has at the requested size, and report the
+  // mode actually set so that a lower rate than expected does not go unnoticed.
   if (fullScreenDisplay >= 0) {
-    glfwSetWindowMonitor(m_window, fullScreenMonitor, 0, 0, width, height, fps);
+    const GLFWvidmode* fastest = findFastestVideoMode(fullScreenMonitor, width, height);
+    if (!fastest) {
+      std::cerr << "Monitor " << fullScreenDisplay << " has no " << width << "x" << height
+        << " mode, the closest will be used (see --listModes)" << std::endl;
+    } else if (!fpsSet) {
+      fps = fastest->refreshRate;
+    } else if (fastest->refreshRate > fps) {
+      std::cerr << "Monitor " << fullScreenDisplay << " supports " << fastest->refreshRate << " Hz at " << width
+        << "x" << height << " but --fps asked for " << fps << std::endl;
+    }
+    glfwSetWindowMonitor(m_window, fullScreenMonitor, 0, 0, width, height, static_cast<int>(std::lround(fps)));
+    const GLFWvidmode* mode = glfwGetVideoMode(fullScreenMonitor);
+    if (mode) {
+      std::cout << "Video mode: " << describeVideoMode(*mode) << std::endl;
+      if (mode->width != width || mode->height != height || mode->refreshRate != static_cast<int>(std::lround(fps))) {
+        std::cerr << "Requested " << width << "x" << height << " at " << fps << " Hz but the monitor is running "
+          << describeVideoMode(*mode) << std::endl;
+      }
+      fps = mode->refreshRate;
+    }
   }
 
   // Make the window's context current
@@ -393,20 +1890,89 @@ int main(int argc, char* argv[])
   // Clear any OpenGL error that Glew caused.  On Non-Windows platforms, this can cause a spurious error 1280.
   glGetError();
 
+  // Pacing modes are the number of vblanks each swap waits for; -1 is adaptive vsync, which swaps
+  // immediately when a frame is late.  The latency probe cycles through the ones available.
+  std::vector<int> pacingModes = { 1, 0 };
+  if (glfwExtensionSupported("GLX_EXT_swap_control_tear") || glfwExtensionSupported("WGL_EXT_swap_control_tear")) {
+    pacingModes.push_back(-1);
+  }
+  auto pacingName = [](int interval) {
+    return interval == 1 ? std::string("vsync") : interval == 0 ? std::string("immediate") :
+      interval == -1 ? std::string("adaptive vsync") : "swap interval " + std::to_string(interval);
+  };
+  std::string pacingMode = "driver default";
+  if (swapIntervalSet) {
+    glfwSwapInterval(swapInterval);
+    pacingMode = pacingName(swapInterval);
+  }
+
+  // Create the plane buffers and vertex layouts with direct state access when the driver has it.
+  MeshPlane::directStateAccess = !noDirectStateAccess && (GLEW_ARB_direct_state_access || GLEW_VERSION_4_5);
+  std::cout << "Direct state access: " << (MeshPlane::directStateAccess ? "yes" : "no") << std::endl;
+
+  // Record from here on, so that the stream holds all of the state setup.
+  std::unique_ptr<GLRecorder> recorder;
+  if (!recordFile.empty()) {
+    try {
+      recorder.reset(new GLRecorder(recordFile, width, height));
+    } catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 8;
+    }
+    GLRecorder::current = recorder.get();
+  }
+
+  // Route driver debug and performance messages into our log.
+  std::unique_ptr<DebugLog> debugLog;
+  if (debugContext) {
+    if (GLEW_KHR_debug || GLEW_VERSION_4_3) {
+      debugLog.reset(new DebugLog());
+      debugLog->install();
+    } else {
+      std::cerr << "KHR_debug not supported, debug messages will not be logged" << std::endl;
+    }
+  }
+
+  // GPU culling needs compute shaders and storage buffers from OpenGL 4.3.  Without them, build the
+  // separate planes and draw each one.
+  if (useGpuCulling && !GLEW_VERSION_4_3) {
+    std::cerr << "OpenGL 4.3 not supported, GPU culling disabled" << std::endl;
+    useGpuCulling = false;
+    planes = makePlanes(geometry, packedPositions);
+  }
+
   //================================================================================================
   // Shaders and OpenGL program variables setup
 
+  // Shader sources come from files if they were specified, otherwise from the built-in strings.
+  const GLchar* builtInVertexShader = geometry == MeshGeometry::Indexed ? VertexShader : PaletteVertexShader;
+  const GLchar* builtInFragmentShader = geometry == MeshGeometry::Indexed ? FragmentShader : PaletteFragmentShader;
+  if (useGpuCulling) {
+    builtInVertexShader = geometry == MeshGeometry::Indexed ? InstancedVertexShader : InstancedPaletteVertexShader;
+    builtInFragmentShader = geometry == MeshGeometry::Indexed ? FragmentShader : InstancedPaletteFragmentShader;
+  }
+  std::string vertexSource, fragmentSource;
+  try {
+    vertexSource = ShaderReloader::loadSource(vertexShaderFile, builtInVertexShader);
+    fragmentSource = ShaderReloader::loadSource(fragmentShaderFile, builtInFragmentShader);
+  } catch (std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 6;
+  }
+  const GLchar* vertexSourceText = vertexSource.c_str();
+  const GLchar* fragmentSourceText = fragmentSource.c_str();
+
   // Construct the shader programs.
   GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
   GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
 
   // vertex shader
-  glShaderSource(vertexShaderId, 1, &VertexShader, NULL);
+  glShaderSource(vertexShaderId, 1, &vertexSourceText, NULL);
   glCompileShader(vertexShaderId);
   checkShaderError(vertexShaderId, "Vertex shader compilation failed.");
 
   // fragment shader
-  glShaderSource(fragmentShaderId, 1, &FragmentShader, NULL);
+  glShaderSource(fragmentShaderId, 1, &fragmentSourceText, NULL);
   glCompileShader(fragmentShaderId);
   checkShaderError(fragmentShaderId, "Fragment shader compilation failed.");
 
@@ -422,100 +1988,444 @@ int main(int argc, char* argv[])
   glDeleteShader(fragmentShaderId);
 
   GLuint modelViewProjectionUniformId = glGetUniformLocation(programId, "modelViewProjection");
+  GLuint viewProjectionUniformId = glGetUniformLocation(programId, "viewProjection");
+
+  // Watch shader files for changes and rebuild the program in the background.  Reloaded programs are
+  // built in another context, so they cannot be recorded.
+  std::unique_ptr<ShaderReloader> shaderReloader;
+  if ((!vertexShaderFile.empty() || !fragmentShaderFile.empty()) && !recorder) {
+    shaderReloader.reset(new ShaderReloader(m_window, vertexShaderFile, fragmentShaderFile,
+      builtInVertexShader, builtInFragmentShader));
+  }
 
-  glUseProgram(programId);
-  glDisable(GL_CULL_FACE);
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LESS);
+  // Reversed-Z needs a [0,1] clip-space depth range, which requires ARB_clip_control (core in 4.5).
+  if (reversedZ && !GLEW_ARB_clip_control) {
+    std::cerr << "ARB_clip_control not supported, using standard depth" << std::endl;
+    reversedZ = false;
+  }
 
-  //================================================================================================
-  // Make our geometry objects, which will know how to draw themselves.  There will be 21 of them with
-  // colors chosen from a set of 6. They will each be translated and then rotated around the Y and X axes
-  // by different amounts, so we construct combined model transform matrices for each.
-  float radius = 5.0f;
-  size_t quadsPerEdge = 10;
-  size_t trianglesPerSide = 2 * quadsPerEdge * quadsPerEdge;
-  // 6 faces
-  size_t numTriangles = static_cast<size_t>(trianglesPerSide * 6);
-  std::vector< std::array<float, 3> > colors = {
-    {1.0f, 0.5f, 0.5f},
-    {0.5f, 1.0f, 0.5f},
-    {0.5f, 0.5f, 1.0f},
-    {1.0f, 1.0f, 0.5f},
-    {0.5f, 1.0f, 1.0f},
-    {1.0f, 0.5f, 1.0f}
-  };
-  std::vector< std::shared_ptr<MeshPlane> > planes;
-  std::vector< std::array<float, 16> > transforms;
-  unsigned NX = 7;
-  unsigned NY = 3;
-  float rotX = 30.0f;
-  float rotY = 30.0f;
-  for (unsigned i = 0; i < NX; i++) {
-    for (unsigned j = 0; j < NY; j++) {
-      planes.push_back(std::shared_ptr<MeshPlane>(
-        new MeshPlane(radius, numTriangles, colors[(i + j) % colors.size()])));
+  // When using reversed-Z, render into an offscreen target with a floating-point depth buffer.
+  std::unique_ptr<RenderTarget> renderTarget;
+  if (reversedZ) {
+    renderTarget.reset(new RenderTarget(width, height));
+    glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+  }
 
-      // Translate in Z so that we can see the planes.
-      std::array<float, 16> translation;
-      createTranslationMatrix(0.0f, 0.0f, -2.0f * radius, translation.data());
+  // Per-row frame checksums need compute shaders and storage buffers from OpenGL 4.3.
+  std::unique_ptr<RowChecksums> rowChecksums;
+  if (useRowChecksums) {
+    if (GLEW_VERSION_4_3) {
+      rowChecksums.reset(new RowChecksums(width, height));
+    } else {
+      std::cerr << "OpenGL 4.3 not supported, row checksums disabled" << std::endl;
+    }
+  }
 
-      // Rotate around Y first, then X.
-      std::array<float, 16> rotationX;
-      createRotationMatrixY(degreesToRadians(rotX * (i - (NX-1)/2.0f)), rotationX.data());
-      std::array<float, 16> rotationY;
-      createRotationMatrixX(degreesToRadians(rotY * (j - (NY-1)/2.0f)), rotationY.data());
-      std::array<float, 16> xform;
-      multiplyMatrices({translation.data(), rotationY.data(), rotationX.data()}, xform.data());
-      transforms.push_back(xform);
+  // The instances' matrices include the mapping from packed positions, so the shared plane's stored
+  // coordinates can be culled and drawn directly.
+  std::unique_ptr<GpuCulling> gpuCulling;
+  if (useGpuCulling) {
+    std::vector< std::array<float, 16> > instanceMatrices(transforms.size());
+    for (size_t p = 0; p < transforms.size(); p++) {
+      planes[0]->applyPositionMatrix(transforms[p].data(), instanceMatrices[p].data());
+    }
+    gpuCulling.reset(new GpuCulling(instanceMatrices, planeColors, planes[0]->getPositionBounds(),
+      planes[0]->getIndirectCommand(), reversedZ));
+    if (useHiZ) {
+      gpuCulling->enableOcclusion(width, height);
+    }
+  }
+
+  // Occlusion queries test each separately drawn plane.
+  std::unique_ptr<OcclusionQueries> occlusionQueries;
+  if (useOcclusionQueries && !gpuCulling) {
+    occlusionQueries.reset(new OcclusionQueries(planes.size()));
+  }
+
+  // The overlay graphs pacing against the requested refresh rate.
+  std::unique_ptr<FrameHud> hud;
+  if (useHud) {
+    if (GLEW_VERSION_3_3) {
+      hud.reset(new FrameHud(width, height, fps));
+    } else {
+      std::cerr << "OpenGL 3.3 not supported, HUD disabled" << std::endl;
     }
   }
 
+  std::unique_ptr<LatencyProbe> latencyProbe;
+  bool pacingKeyDown = false;
+  if (useLatencyProbe) {
+    latencyProbe.reset(new LatencyProbe(m_window, width, height, pacingMode));
+    std::cout << "Press keys or mouse buttons to measure latency, P to change the pacing mode ("
+      << pacingMode << ")" << std::endl;
+  }
+
+  glUseProgram(programId);
+  glDisable(GL_CULL_FACE);
+  glEnable(GL_DEPTH_TEST);
+  glDepthFunc(reversedZ ? GL_GREATER : GL_LESS);
+
   // Construct the projection matrix.
   std::array<float, 16> projection;
-  createProjectionMatrix(150.0f, static_cast<float>(width) / static_cast<float>(height),
-    0.1f, 100.0f, projection.data());
+  createSceneProjectionMatrix(width, height, reversedZ, projection.data());
+
+  // Compare the ways of drawing the planes instead of running if we've been asked to.
+  if (benchmarkFrames > 0) {
+    planes.clear();
+    gpuCulling.reset();
+    occlusionQueries.reset();
+    hud.reset();
+    latencyProbe.reset();
+    runGeometryBenchmark(benchmarkFrames, makePlanes, transforms, projection, renderTarget.get(), reversedZ);
+    renderTarget.reset();
+    rowChecksums.reset();
+    shaderReloader.reset();
+    glfwMakeContextCurrent(nullptr);
+    glfwDestroyWindow(m_window);
+    glfwTerminate();
+    return 0;
+  }
+
+  //================================================================================================
+  // Scheduling of the render thread.  This is done once everything is set up, so that the driver's
+  // and the shader reloader's threads do not inherit the core or the real-time priority.  Failures
+  // are reported and the program runs without the setting.
+
+  if (cpuCore >= 0) {
+    try {
+      pinThreadToCore(cpuCore);
+      std::cout << "Render thread pinned to core " << cpuCore << std::endl;
+    } catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+  if (realTime) {
+    try {
+      setRealTimePriority(realTimePolicy, realTimePriority);
+      std::cout << "Render thread has real-time priority " << realTimePriority << std::endl;
+    } catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+  if (lockMemory) {
+    try {
+      lockAllMemory();
+      std::cout << "Memory locked" << std::endl;
+    } catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+  }
+  std::unique_ptr<ContextSwitchStats> contextSwitchStats;
+  if (contextSwitches) {
+    try {
+      contextSwitchStats.reset(new ContextSwitchStats(fps, contextSwitchLog));
+    } catch (std::exception& e) {
+      std::cerr << e.what() << std::endl;
+      return 9;
+    }
+  }
+
+  // Follow the window's size from here on.
+  glfwSetFramebufferSizeCallback(m_window, framebufferSizeCallback);
+  bool resizing = false;
+  std::chrono::steady_clock::time_point resizeStart, lastFrameEnd;
+  size_t resizeFrames = 0;
+  double resizeLongestFrame = 0;
+
+  // F11 switches between windowed and full screen on the same window and context, on the
+  // --fullScreenDisplay monitor or else the primary one, at the requested size if it has such a mode.
+  const int requestedWidth = width, requestedHeight = height;
+  bool fullScreenKeyDown = false;
+  bool modeSwitched = false;
+  std::chrono::steady_clock::time_point modeSwitchStart;
+  size_t switchFramesChecked = 0, switchPartialFrames = 0;
+  std::cout << "Press F11 to switch between windowed and full screen" << std::endl;
 
   //================================================================================================
   // Timing the main loop.
 
   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
   size_t count = 0;
+  size_t trianglesDrawn = 0;
+  std::vector<size_t> levelDraws;
+  std::vector< std::array<float, 16> > planeMatrices(planes.size());
+  bool captureRequested = !captureFile.empty() || !goldenFile.empty();
+  int exitCode = 0;
 
   // Loop until the user closes the window using Alt-F4 or the close button.
   std::cout << "Use the OS-specific close button or full-screen quit (Alt-F4 or Apple-Q) to close the window." << std::endl;
   while (++count) {
+    if (debugLog) {
+      debugLog->beginFrame(count);
+    }
+    if (hud) {
+      hud->beginFrame();
+    }
+
+    // Switch to a reloaded shader program between frames.
+    if (shaderReloader) {
+      GLuint reloadedProgram = shaderReloader->takeProgram();
+      if (reloadedProgram) {
+        glDeleteProgram(programId);
+        programId = reloadedProgram;
+        glUseProgram(programId);
+        modelViewProjectionUniformId = glGetUniformLocation(programId, "modelViewProjection");
+        viewProjectionUniformId = glGetUniformLocation(programId, "viewProjection");
+      }
+    }
 
-    // Clear the screen
+    // Clear the screen.  Reversed-Z clears depth to the far value of 0.
+    if (renderTarget) {
+      renderTarget->bind();
+    }
     glClearColor(0.6f, 0.8f, 1.0f, 1.0f);
+    glClearDepth(reversedZ ? 0.0 : 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Construct the view transformation matrix.  To reproduce the tearing, we rotate around the Y
-    // axis byt around 90 degrees and then we rotate around the X axis periodically by around +/- 10 degrees from 5.
-    std::array<float, 16> xrot, yrot, view;
-    createRotationMatrixY(degreesToRadians(90.0f), yrot.data());
+    // Construct the view transformation matrix for the current time.
+    std::array<float, 16> view;
     std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
     std::chrono::duration<double> elapsed = now - start;
-    float angle = 5 + 10.0f * sin(0.5 * Pi * elapsed.count());
-    createRotationMatrixX(degreesToRadians(angle), xrot.data());
-    multiplyMatrices({yrot.data(), xrot.data()}, view.data());
+    createViewMatrix(fixedTime >= 0 ? fixedTime : elapsed.count(), view.data());
+
+    // Cull the instances on the GPU and draw the visible ones with one command, or construct the
+    // model+view+projection matrix for each plane and draw it.
+    std::array<float, 16> modelViewProjection, drawMatrix;
+    if (gpuCulling) {
+      std::array<float, 16> viewProjection;
+      multiplyMatrices({ view.data(), projection.data() }, viewProjection.data());
+      gpuCulling->cull(viewProjection.data());
+      glUniformMatrix4fv(viewProjectionUniformId, 1, GL_FALSE, viewProjection.data());
+      planes[0]->drawIndirect(gpuCulling->getCommandBuffer());
+      if (!resizing) {
+        gpuCulling->buildDepthPyramid();
+      }
+      gpuCulling->collect();
+    } else {
+      for (size_t p = 0; p < planes.size(); p++) {
+        auto const &plane = planes[p];
+        multiplyMatrices({ transforms[p].data(), view.data(), projection.data()}, modelViewProjection.data());
+        plane->applyPositionMatrix(modelViewProjection.data(), drawMatrix.data());
+        glUniformMatrix4fv(modelViewProjectionUniformId, 1, GL_FALSE, drawMatrix.data());
+        size_t level = 0;
+        if (useLod) {
+          level = plane->selectLevel(modelViewProjection.data(), width, height, lodPixelsPerTriangle);
+          if (level >= levelDraws.size()) { levelDraws.resize(level + 1); }
+          levelDraws[level]++;
+        }
+        if (occlusionQueries) {
+          occlusionQueries->beginConditionalDraw(p);
+        }
+        plane->draw(level);
+        if (occlusionQueries) {
+          occlusionQueries->endConditionalDraw();
+        }
+        trianglesDrawn += plane->getNumTriangles(level);
+        planeMatrices[p] = modelViewProjection;
+      }
 
-    // Construct the model+view+projection matrix for each plane.
-    std::array<float, 16> modelViewProjection;
-    for (size_t p = 0; p < planes.size(); p++) {
-      auto const &plane = planes[p];
-      multiplyMatrices({ transforms[p].data(), view.data(), projection.data()}, modelViewProjection.data());
-      glUniformMatrix4fv(modelViewProjectionUniformId, 1, GL_FALSE, modelViewProjection.data());
-      plane->draw();
+      // Test the planes' boxes against this frame's depth, to skip the hidden ones in the next frame.
+      if (occlusionQueries) {
+        occlusionQueries->issueQueries(planeMatrices, planeScale, reversedZ ? GL_GREATER : GL_LESS);
+      }
+    }
+
+    // Copy the offscreen image to the window if we rendered into one.
+    if (renderTarget) {
+      renderTarget->blitToWindow(width, height);
+    }
+
+    // Hash the rows of the finished frame and check any earlier results that are ready.  Not while
+    // the window is being resized, since the frame may no longer be the size the hashes are.
+    if (rowChecksums && !resizing) {
+      rowChecksums->process(count);
+      rowChecksums->collect();
+    }
+
+    // Capture and check the requested frame, then stop.
+    if (captureRequested && count == captureFrame) {
+      exitCode = checkCapturedImage(captureFramebuffer(width, height), captureFile, goldenFile, tolerance,
+        cpuThreads);
+      break;
+    }
+
+    // Draw the overlay over the finished frame, after it has been checked.
+    if (hud) {
+      if (rowChecksums) {
+        hud->setTornFrames(rowChecksums->getPartialFrames());
+      }
+      hud->draw();
+    }
+
+    // Show that the frame has seen the input events since the previous one.
+    if (latencyProbe) {
+      latencyProbe->drawMarker();
     }
 
     // Swap front and back buffers and wait for it to complete.
+    if (recorder) {
+      recorder->swapBuffers();
+    }
     glfwSwapBuffers(m_window);
+    if (latencyProbe) {
+      latencyProbe->swapped();
+    }
     glFinish();
+    if (latencyProbe) {
+      latencyProbe->completed();
+    }
+    std::chrono::steady_clock::time_point frameEnd = std::chrono::steady_clock::now();
+    if (resizing) {
+      resizeFrames++;
+      resizeLongestFrame = std::max(resizeLongestFrame, std::chrono::duration<double>(frameEnd - lastFrameEnd).count());
+    }
+    lastFrameEnd = frameEnd;
+
+    // Time from switching between windowed and full screen until the first frame after it was done.
+    if (modeSwitched) {
+      std::cout << "  First frame complete " << std::chrono::duration<double>(frameEnd - modeSwitchStart).count() * 1e3
+        << " ms after the switch" << std::endl;
+      modeSwitched = false;
+    }
+
+    // Count the context switches since the previous frame finished.
+    if (contextSwitchStats) {
+      contextSwitchStats->sample(count);
+    }
+
+    // Stop once the requested frames have been recorded.
+    if (recorder) {
+      recorder->endFrame();
+      if (recorder->getFrames() >= recordFrames) {
+        break;
+      }
+    }
 
     // Poll for and process events, including window closure.
     glfwPollEvents();
 
+    // Follow a change of the window's size.  The projection and viewport change at once, and until the
+    // size settles the frame is rendered into the existing offscreen targets and stretched to the
+    // window, so that dragging an edge of an 8K window does not reallocate them on every step.
+    if (framebufferResize.pending) {
+      framebufferResize.pending = false;
+      width = framebufferResize.width;
+      height = framebufferResize.height;
+      createSceneProjectionMatrix(width, height, reversedZ, projection.data());
+      glViewport(0, 0, width, height);
+      if (hud) {
+        hud->setSize(width, height);
+      }
+      if (latencyProbe) {
+        latencyProbe->setSize(width, height);
+      }
+      if (gpuCulling) {
+        gpuCulling->invalidateDepthPyramid();
+      }
+      if (!resizing) {
+        resizing = true;
+        resizeStart = framebufferResize.time;
+        resizeFrames = 0;
+        resizeLongestFrame = 0;
+      }
+    }
+    if (resizing && std::chrono::steady_clock::now() - framebufferResize.time >= ResizeSettleTime) {
+      std::chrono::steady_clock::time_point reallocateStart = std::chrono::steady_clock::now();
+      if (renderTarget && (renderTarget->getWidth() != width || renderTarget->getHeight() != height)) {
+        renderTarget.reset(new RenderTarget(width, height));
+      }
+      if (rowChecksums) {
+        rowChecksums->resize(width, height);
+      }
+      if (gpuCulling) {
+        gpuCulling->resizeOcclusion(width, height);
+      }
+      glFinish();
+      std::chrono::steady_clock::time_point reallocateEnd = std::chrono::steady_clock::now();
+      std::cout << "Resized to " << width << "x" << height << ": " << resizeFrames << " frames in "
+        << std::chrono::duration<double>(reallocateStart - resizeStart).count() * 1e3 << " ms, longest "
+        << resizeLongestFrame * 1e3 << " ms; targets reallocated in "
+        << std::chrono::duration<double>(reallocateEnd - reallocateStart).count() * 1e3 << " ms" << std::endl;
+      resizing = false;
+    }
+
+    // P moves the latency probe on to the next pacing mode.
+    if (latencyProbe) {
+      bool pacingKey = glfwGetKey(m_window, GLFW_KEY_P) == GLFW_PRESS;
+      if (pacingKey && !pacingKeyDown) {
+        size_t next = 0;
+        if (swapIntervalSet) {
+          next = (std::find(pacingModes.begin(), pacingModes.end(), swapInterval) - pacingModes.begin() + 1) %
+            pacingModes.size();
+        }
+        swapInterval = pacingModes[next];
+        swapIntervalSet = true;
+        glfwSwapInterval(swapInterval);
+        pacingMode = pacingName(swapInterval);
+        latencyProbe->setMode(pacingMode);
+        std::cout << "Pacing: " << pacingMode << std::endl;
+      }
+      pacingKeyDown = pacingKey;
+    }
+
+    // Switch between windowed and full screen, keeping every GL object.  The new framebuffer size
+    // arrives through the size callback like any other resize.
+    bool fullScreenKey = glfwGetKey(m_window, GLFW_KEY_F11) == GLFW_PRESS;
+    if (fullScreenKey && !fullScreenKeyDown) {
+      bool toFullScreen = glfwGetWindowMonitor(m_window) == nullptr;
+      GLFWmonitor* monitor = nullptr;
+      const GLFWvidmode* mode = nullptr;
+      if (toFullScreen) {
+        monitor = fullScreenMonitor ? fullScreenMonitor : glfwGetPrimaryMonitor();
+        if (monitor) {
+          mode = findFastestVideoMode(monitor, requestedWidth, requestedHeight);
+          if (!mode) {
+            mode = glfwGetVideoMode(monitor);
+          }
+        }
+      }
+      if (toFullScreen && !mode) {
+        std::cerr << "No monitor video mode to switch to full screen with" << std::endl;
+      } else {
+        if (rowChecksums) {
+          std::cout << "Torn frames while " << (toFullScreen ? "windowed" : "full screen") << ": "
+            << rowChecksums->getPartialFrames() - switchPartialFrames << " of "
+            << rowChecksums->getFramesChecked() - switchFramesChecked << " checked" << std::endl;
+          switchPartialFrames = rowChecksums->getPartialFrames();
+          switchFramesChecked = rowChecksums->getFramesChecked();
+        }
+        modeSwitchStart = std::chrono::steady_clock::now();
+        std::string description;
+        double refreshRate = 0;
+        if (toFullScreen) {
+          glfwGetWindowPos(m_window, &windowedX, &windowedY);
+          glfwGetWindowSize(m_window, &windowedWidth, &windowedHeight);
+          glfwSetWindowMonitor(m_window, monitor, 0, 0, mode->width, mode->height,
+            fpsSet ? static_cast<int>(std::lround(fps)) : mode->refreshRate);
+          const GLFWvidmode* actual = glfwGetVideoMode(monitor);
+          description = "full screen, " + describeVideoMode(actual ? *actual : *mode);
+          refreshRate = (actual ? actual : mode)->refreshRate;
+        } else {
+          glfwSetWindowMonitor(m_window, nullptr, windowedX, windowedY, windowedWidth, windowedHeight, GLFW_DONT_CARE);
+          description = "windowed, " + std::to_string(windowedWidth) + "x" + std::to_string(windowedHeight);
+          refreshRate = windowedFps;
+        }
+
+        // Missed vblanks and late frames are counted against the new mode's refresh period.
+        if (hud && refreshRate > 0) {
+          hud->setRefreshRate(refreshRate);
+        }
+        if (contextSwitchStats && refreshRate > 0) {
+          contextSwitchStats->setRefreshRate(refreshRate);
+        }
+        std::chrono::steady_clock::time_point modeSwitchEnd = std::chrono::steady_clock::now();
+        std::cout << "Switched to " << description << " in "
+          << std::chrono::duration<double>(modeSwitchEnd - modeSwitchStart).count() * 1e3 << " ms" << std::endl;
+        modeSwitched = true;
+      }
+    }
+    fullScreenKeyDown = fullScreenKey;
+
     // Done when the user closes the window.
     if (glfwWindowShouldClose(m_window)) {
       std::cout << "Closing window" << std::endl;
@@ -524,17 +2434,65 @@ int main(int argc, char* argv[])
   }
 
   std::chrono::steady_clock::time_point stop = std::chrono::steady_clock::now();
+  GLRecorder::current = nullptr;
   std::chrono::duration<double> elapsed = stop - start;
   std::cout << "Elapsed time: " << elapsed.count() << " seconds" << std::endl;
   std::cout << "Frames per second: " << count / elapsed.count() << std::endl;
+  if (gpuCulling) {
+    gpuCulling->collect(true);
+    trianglesDrawn = static_cast<size_t>(gpuCulling->getMeanVisible() * planes[0]->getNumTriangles() * count);
+  }
+  std::cout << "Triangles per frame: " << trianglesDrawn / count << std::endl;
+  if (useLod) {
+    std::cout << "Plane draws by level of detail:";
+    for (size_t l = 0; l < levelDraws.size(); l++) {
+      std::cout << " " << l << ":" << levelDraws[l];
+    }
+    std::cout << std::endl;
+  }
+  if (rowChecksums) {
+    rowChecksums->collect(true);
+    rowChecksums->report();
+  }
+  if (gpuCulling) {
+    gpuCulling->report();
+  }
+  if (occlusionQueries) {
+    occlusionQueries->report();
+  }
+  if (hud) {
+    hud->report();
+  }
+  if (latencyProbe) {
+    latencyProbe->report();
+  }
+  if (contextSwitchStats) {
+    contextSwitchStats->report();
+  }
+  if (recorder) {
+    std::cout << "Recorded " << recorder->getCalls() << " GL calls in " << recorder->getFrames()
+      << " frames (" << recorder->getBytes() << " bytes) to " << recordFile << std::endl;
+  }
+  if (debugLog) {
+    glDebugMessageCallback(nullptr, nullptr);
+    debugLog->report();
+  }
 
   //================================================================================================
   // Done with everything, free our context and quit GLFW.
 
   planes.clear();
+  gpuCulling.reset();
+  occlusionQueries.reset();
+  hud.reset();
+  latencyProbe.reset();
+  renderTarget.reset();
+  rowChecksums.reset();
+  shaderReloader.reset();
+  recorder.reset();
   glfwMakeContextCurrent(nullptr);
   glfwDestroyWindow(m_window);
   glfwTerminate();
 
-  return 0;
+  return exitCode;
 }
\ No newline at end of file